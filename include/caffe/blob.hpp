@@ -24,7 +24,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), data_offset_(0),
+         diff_offset_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -216,6 +217,11 @@ class Blob {
     return diff_;
   }
 
+  /// @brief The offset of this Blob's data_ (diff_) within its SyncedMemory,
+  ///        nonzero for views created by ShareData(other, offset).
+  inline int data_offset() const { return data_offset_; }
+  inline int diff_offset() const { return diff_offset_; }
+
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
   const int* gpu_shape() const;
@@ -262,6 +268,37 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Makes this Blob's data_ a view of count() elements of the data_ of
+   *        Blob other, starting at offset -- e.g. to let a layer write its
+   *        output straight into a slice of a Concat layer's output.
+   *
+   * The view is dropped, and memory of its own allocated, if the Blob is later
+   * reshaped to a larger count.
+   */
+  void ShareData(const Blob& other, const int offset);
+  /// @brief Makes this Blob's diff_ a view into the diff_ of Blob other.
+  void ShareDiff(const Blob& other, const int offset);
+  /**
+   * @brief Gives this Blob memory of its own for data_ and diff_, ending any
+   *        sharing; the data are copied over if copy_data is true.
+   */
+  void Unshare(const bool copy_data);
+  /**
+   * @brief Releases the memory holding this Blob's data_; it is reallocated,
+   *        uninitialized, the next time the data are accessed.
+   *
+   * Blobs sharing the data (see ShareData) keep the old memory alive.
+   */
+  void ReleaseData();
+  /**
+   * @brief Makes memory, which must be large enough for the Blob's capacity,
+   *        hold this Blob's diff_ (e.g. to reuse a buffer that is not in use).
+   *
+   * The diff_ keeps its offset, so views sharing a SyncedMemory can be moved
+   * together.
+   */
+  void set_diff_memory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -272,6 +309,8 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  int data_offset_;
+  int diff_offset_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
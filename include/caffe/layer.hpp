@@ -10,6 +10,8 @@
 #include "caffe/layer_factory.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/trace.hpp"
 
 /**
  Forward declare boost::thread instead of including boost/thread.hpp
@@ -19,6 +21,8 @@ namespace boost { class mutex; }
 
 namespace caffe {
 
+class Timer;
+
 /**
  * @brief An interface for the units of computation which can be composed into a
  *        Net.
@@ -294,6 +298,60 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may be rerun on the same bottoms to
+   *        recompute the tops, as done by Net in recompute mode.
+   *
+   * Layers whose Forward draws random numbers or updates internal state
+   * (e.g. running statistics) return false.
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
+  /**
+   * @brief Return whether Net may reuse the memory of this layer's bottom and
+   *        top blobs for other blobs while they are not in use.
+   *
+   * Layers that keep results in a diff from Forward to Backward, use diffs as
+   * scratch space in Forward, or share their blobs with memory the Net does
+   * not see return false.
+   */
+  virtual inline bool AllowMemoryReuse() const { return true; }
+
+  /**
+   * @brief Return whether Net may run this layer on a worker thread,
+   *        concurrently with other layers.
+   *
+   * Layers drawing from Caffe's thread local random number generator, or
+   * otherwise depending on the thread calling Net::Forward, return false;
+   * they are run on the calling thread, in order.
+   */
+  virtual inline bool AllowParallel() const { return true; }
+
+  /**
+   * @brief Return the floating point operations of Forward for the current
+   *        shapes, for profiling.
+   *
+   * The default counts one operation per top element; layers dominated by
+   * other work (e.g. matrix products) override it.
+   */
+  virtual double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
+  /// @brief As ForwardFlops, for Backward; by default one per bottom element.
+  virtual double BackwardFlops(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) const;
+  /**
+   * @brief Return the bytes Forward reads and writes for the current shapes,
+   *        for profiling; by default the bottoms, tops and parameters once.
+   */
+  virtual double ForwardBytes(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const;
+  /**
+   * @brief As ForwardBytes, for Backward; by default the data and diffs of the
+   *        bottoms, tops and parameters once.
+   */
+  virtual double BackwardBytes(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) const;
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -441,6 +499,14 @@ class Layer {
   /** Unlock forward_mutex_ if this layer is shared */
   void Unlock();
 
+  /** Times Forward and Backward while the Profiler is enabled, and holds
+   *  the PerfCounters read when they started */
+  shared_ptr<Timer> profile_timer_;
+  vector<uint64_t> profile_counters_;
+  void StartProfile();
+  void StopProfile(bool backward, const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 };  // class Layer
 
@@ -452,8 +518,11 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   // Lock during forward to ensure sequential forward
   Lock();
+  TraceSpan trace(layer_param_.name(), "forward");
   Dtype loss = 0;
   Reshape(bottom, top);
+  const bool profile = Profiler::enabled();
+  if (profile) { StartProfile(); }
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -482,6 +551,7 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   default:
     LOG(FATAL) << "Unknown caffe mode.";
   }
+  if (profile) { StopProfile(false, bottom, top); }
   Unlock();
   return loss;
 }
@@ -490,6 +560,9 @@ template <typename Dtype>
 inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  TraceSpan trace(layer_param_.name(), "backward");
+  const bool profile = Profiler::enabled();
+  if (profile) { StartProfile(); }
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Backward_cpu(top, propagate_down, bottom);
@@ -500,6 +573,7 @@ inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
   default:
     LOG(FATAL) << "Unknown caffe mode.";
   }
+  if (profile) { StopProfile(true, bottom, top); }
 }
 
 // Serialize LayerParameter to protocol buffer
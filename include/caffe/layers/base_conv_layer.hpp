@@ -28,18 +28,46 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
 
+  // Two per multiply-add of the matrix products; Backward computes both the
+  // weight and the bottom gradients.
+  virtual inline double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return 2.0 * bottom.size() * num_ * conv_out_channels_ *
+        conv_out_spatial_dim_ * kernel_dim_;
+  }
+  virtual inline double BackwardFlops(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) const {
+    return 2 * ForwardFlops(bottom, top);
+  }
+
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // we just called weight_cpu_gemm with the same input. The bias helpers take
+  // channels_last for outputs in NHWC order.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
-  void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  void forward_cpu_bias(Dtype* output, const Dtype* bias,
+      bool channels_last = false);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
-  void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  void backward_cpu_bias(Dtype* bias, const Dtype* input,
+      bool channels_last = false);
+  // Versions of the above for num (at most gemm_batch_) consecutive images,
+  // which lower them side by side into one column buffer so that each group
+  // takes a single, wider GEMM.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, int num, bool skip_im2col = false);
+  void backward_cpu_gemm_batch(const Dtype* output, const Dtype* weights,
+      Dtype* input, int num);
+  void weight_cpu_gemm_batch(const Dtype* input, const Dtype* output,
+      Dtype* weights, int num);
+  /// @brief The number of images to lower at once within bytes of buffers.
+  int gemm_batch_for_bytes(uint64_t bytes) const;
+  /// @brief Sets gemm_batch_, shaping the buffers of the batch.
+  void set_gemm_batch(int gemm_batch);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,6 +120,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief The number of images the CPU GEMM helpers lower at once.
+  int gemm_batch_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -166,6 +196,9 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int output_offset_;
 
   Blob<Dtype> col_buffer_;
+  // The columns and outputs of gemm_batch_ images, if it is more than one.
+  Blob<Dtype> batch_col_buffer_;
+  Blob<Dtype> batch_output_buffer_;
   Blob<Dtype> bias_multiplier_;
 };
 
@@ -8,6 +8,8 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/conv_algorithm_cache.hpp"
+#include "caffe/util/depthwise_conv.hpp"
 
 namespace caffe {
 
@@ -26,6 +28,12 @@ namespace caffe {
  *   inputs so that the im2col matrix has a column for each input region to
  *   be filtered. col2im restores the output spatial structure by rolling up
  *   the output channel N' columns of the output matrix.
+ *
+ *   Depthwise convolutions, where each group has a single input channel, are
+ *   instead computed directly on the CPU, as their per-group matrices are too
+ *   small for BLAS and im2col would dominate. cpu_algorithm overrides this
+ *   choice, or with AUTOTUNE times the algorithms for each input shape and
+ *   remembers the fastest in the ConvAlgorithmCache.
  */
 template <typename Dtype>
 class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
@@ -60,9 +68,19 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *  - cpu_algorithm (\b optional, default HEURISTIC). The algorithm of the
+   *    CPU implementation: GEMM, DIRECT (depthwise only), or the fastest of
+   *    them with AUTOTUNE.
+   *  - layout (\b optional, default NCHW). NHWC for channels-last bottom
+   *    and top data, for 1x1 convolutions on the CPU.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), channels_last_(false),
+        direct_(false), tuned_gemm_batch_(1) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
 
@@ -77,6 +95,71 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  /// @brief Whether the CPU implementation convolves each input channel
+  ///        directly, as each group has one.
+  inline bool depthwise() const {
+    return this->group_ > 1 && this->group_ == this->channels_ &&
+        this->num_spatial_axes_ == 2 && !this->force_nd_im2col_;
+  }
+  /// @brief Times the CPU algorithms on blobs shaped like bottom and top, and
+  ///        returns the fastest, unless the cache already knows it.
+  ConvAlgorithmCache::Choice Autotune(const Blob<Dtype>& bottom,
+      const Blob<Dtype>& top);
+
+  /// @brief Whether the data of the bottom and top are in NHWC order.
+  bool channels_last_;
+  /// @brief Whether the CPU implementation uses the depthwise kernels rather
+  ///        than im2col and GEMM.
+  bool direct_;
+
+ private:
+  // The convolution of the num_ images of one bottom, without bias.
+  void forward_cpu_convolution(const Dtype* bottom_data, const Dtype* weight,
+      Dtype* top_data);
+  // The gradients w.r.t. the weights and the bottom, each skipped when NULL.
+  void backward_cpu_convolution(const Dtype* top_diff,
+      const Dtype* bottom_data, const Dtype* weight, Dtype* weight_diff,
+      Dtype* bottom_diff);
+
+  int tuned_gemm_batch_;
+  vector<int> tuned_shape_;
+
+  // wrap the depthwise kernels so we don't have to remember the (long)
+  // argument lists
+  inline void forward_cpu_depthwise(const Dtype* input, const Dtype* weights,
+      Dtype* output) {
+    depthwise_conv_cpu(input, this->channels_,
+        this->input_shape(1), this->input_shape(2),
+        this->num_output_ / this->group_,
+        this->kernel_shape_.cpu_data()[0], this->kernel_shape_.cpu_data()[1],
+        this->pad_.cpu_data()[0], this->pad_.cpu_data()[1],
+        this->stride_.cpu_data()[0], this->stride_.cpu_data()[1],
+        this->dilation_.cpu_data()[0], this->dilation_.cpu_data()[1],
+        weights, output);
+  }
+  inline void backward_cpu_depthwise(const Dtype* output,
+      const Dtype* weights, Dtype* input) {
+    depthwise_conv_backward_cpu(output, this->channels_,
+        this->input_shape(1), this->input_shape(2),
+        this->num_output_ / this->group_,
+        this->kernel_shape_.cpu_data()[0], this->kernel_shape_.cpu_data()[1],
+        this->pad_.cpu_data()[0], this->pad_.cpu_data()[1],
+        this->stride_.cpu_data()[0], this->stride_.cpu_data()[1],
+        this->dilation_.cpu_data()[0], this->dilation_.cpu_data()[1],
+        weights, input);
+  }
+  inline void weight_cpu_depthwise(const Dtype* input, const Dtype* output,
+      Dtype* weights) {
+    depthwise_conv_weight_cpu(input, output, this->channels_,
+        this->input_shape(1), this->input_shape(2),
+        this->num_output_ / this->group_,
+        this->kernel_shape_.cpu_data()[0], this->kernel_shape_.cpu_data()[1],
+        this->pad_.cpu_data()[0], this->pad_.cpu_data()[1],
+        this->stride_.cpu_data()[0], this->stride_.cpu_data()[1],
+        this->dilation_.cpu_data()[0], this->dilation_.cpu_data()[1],
+        weights);
+  }
 };
 
 }  // namespace caffe
@@ -61,6 +61,7 @@ class HingeLossLayer : public LossLayer<Dtype> {
       : LossLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "HingeLoss"; }
+  virtual inline bool AllowMemoryReuse() const { return false; }
 
  protected:
   /// @copydoc HingeLossLayer
@@ -29,6 +29,15 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual inline double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return 2.0 * M_ * K_ * N_;
+  }
+  virtual inline double BackwardFlops(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) const {
+    return 4.0 * M_ * K_ * N_;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
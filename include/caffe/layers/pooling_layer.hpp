@@ -34,6 +34,16 @@ class PoolingLayer : public Layer<Dtype> {
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
 
+  // One per element of each pooling window.
+  virtual inline double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return static_cast<double>(top[0]->count()) * kernel_h_ * kernel_w_;
+  }
+  virtual inline double BackwardFlops(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) const {
+    return ForwardFlops(bottom, top);
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -39,6 +39,9 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  virtual inline bool AllowRecompute() const { return false; }
+  virtual inline bool AllowParallel() const { return false; }
+  virtual inline bool AllowMemoryReuse() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -34,6 +34,8 @@ class RecurrentLayer : public Layer<Dtype> {
   virtual void Reset();
 
   virtual inline const char* type() const { return "Recurrent"; }
+  virtual inline bool AllowRecompute() const { return false; }
+  virtual inline bool AllowMemoryReuse() const { return false; }
   virtual inline int MinBottomBlobs() const {
     int min_bottoms = 2;
     if (this->layer_param_.recurrent_param().expose_hidden()) {
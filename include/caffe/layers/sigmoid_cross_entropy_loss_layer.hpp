@@ -54,6 +54,7 @@ class SigmoidCrossEntropyLossLayer : public LossLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "SigmoidCrossEntropyLoss"; }
+  virtual inline bool AllowMemoryReuse() const { return false; }
 
  protected:
   /// @copydoc SigmoidCrossEntropyLossLayer
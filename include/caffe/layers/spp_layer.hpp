@@ -32,8 +32,15 @@ class SPPLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // pools every level of the pyramid into its part of top_data, and with
+  // mask non-NULL records the argmax of max pooling there
+  void Pool_cpu(const Dtype* bottom_data, Dtype* top_data, int* mask);
   // calculates the kernel and stride dimensions for the pooling layer,
   // returns a correctly configured LayerParameter for a PoolingLayer
   virtual LayerParameter GetPoolingParam(const int pyramid_level,
@@ -47,6 +54,15 @@ class SPPLayer : public Layer<Dtype> {
   int pad_h_, pad_w_;
   bool reshaped_first_time_;
 
+  /// the windows of each level, as the pooling layers below use them
+  vector<PoolingParameter> level_params_;
+  vector<int> pooled_heights_;
+  vector<int> pooled_widths_;
+  /// the argmax of max pooling, laid out as top
+  Blob<int> max_idx_;
+
+  // The CPU pools each level straight into top; the GPU runs the pyramid of
+  // layers below.
   /// the internal Split layer that feeds the pooling layers
   shared_ptr<SplitLayer<Dtype> > split_layer_;
   /// top vector holder used in call to the underlying SplitLayer::Forward
@@ -1,6 +1,7 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -11,6 +12,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/task_scheduler.hpp"
 
 namespace caffe {
 
@@ -117,8 +119,25 @@ class Net {
   void CopyTrainedLayersFromHDF5(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
+  /**
+   * @brief Writes the net to a binary proto file, streaming the parameters
+   *        to disk instead of building the NetParameter in memory.
+   */
+  void ToBinaryProto(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the net to a binary proto file, taking the parameter values
+   *        from params (e.g. staged copies) instead of the net's own params().
+   */
+  void ParamsToBinaryProto(const string& filename,
+      const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the net to an HDF5 file, taking the parameter values from
+   *        params (e.g. staged copies) instead of the net's own params().
+   */
+  void ParamsToHDF5(const string& filename,
+      const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -242,6 +261,41 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Streams the trained layers from a binary proto file; returns false
+   *        if the file uses the legacy layer format and needs upgrading.
+   */
+  bool StreamTrainedLayersFromBinaryProto(const string& trained_filename);
+
+  /// @brief Makes Concat inputs and Slice outputs views into one blob.
+  void ShareConcatMemory();
+
+  /// @brief Splits the net into segments for recompute mode.
+  void InitRecompute(const NetParameter& param);
+  /// @brief Drops the activations inside a forwarded segment.
+  void DropSegment(const int segment_id);
+  /// @brief Reruns the forward pass of a dropped segment.
+  void RecomputeSegment(const int segment_id);
+
+  /// @brief Plans which blob diffs share memory in Backward.
+  void PlanMemoryReuse();
+
+  /**
+   * @brief Switches to the cached plan for the current input shapes, creating
+   *        it if needed; returns false if the shapes have not changed.
+   */
+  bool SwitchPlan();
+  /// @brief Exchanges the blobs and layers of this net with those of plan.
+  void SwapPlan(Net* plan);
+  /// @brief The bytes of blob data held by the current plan, except inputs.
+  size_t PlanBytes() const;
+
+  /// @brief Builds the dependency graphs for running layers in parallel.
+  void ScheduleLayers();
+  /// @brief Tasks run by the scheduler: forward or backward one layer.
+  void ForwardLayer(int layer_id);
+  void BackwardLayer(int layer_id);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -306,6 +360,34 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Recompute mode: the layer range of each segment, the segment of each
+  /// layer, the ids of the blobs dropped after forwarding each segment, and
+  /// whether each segment has been dropped since it was last forwarded.
+  vector<int> segment_start_;
+  vector<int> segment_end_;
+  vector<int> layer_segment_;
+  vector<vector<int> > segment_drop_blob_ids_;
+  vector<bool> segment_dropped_;
+  /// Whether to reuse memory in Backward, and whether it has been planned.
+  bool reuse_buffers_;
+  bool memory_reuse_planned_;
+  /// Whether to make Concat and Slice layers zero-copy.
+  bool zero_copy_concat_;
+  /// Parallel layers: the scheduler, the layers following each layer in
+  /// Forward and in Backward, the layers run on the calling thread, and the
+  /// loss of each layer, summed in order after Forward.
+  shared_ptr<TaskScheduler> scheduler_;
+  vector<vector<int> > forward_successors_;
+  vector<vector<int> > backward_successors_;
+  vector<bool> layer_on_caller_;
+  vector<Dtype> layer_losses_;
+  /// Plan cache: its budget in bytes, the parameter the plans are built from,
+  /// the input shapes of the current plan, and the other cached plans with
+  /// their input shapes, most recently used first.
+  size_t plan_cache_bytes_;
+  NetParameter plan_param_;
+  vector<vector<int> > plan_shapes_;
+  std::list<pair<vector<vector<int> >, shared_ptr<Net> > > plans_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
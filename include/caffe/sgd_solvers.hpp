@@ -5,9 +5,31 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+/**
+ * @brief The effective gradient of one parameter as seen by the fused CPU
+ *        update: the raw diff scaled by the gradient clipping and iter_size
+ *        normalization factors, plus the weight decay term.
+ */
+template <typename Dtype>
+struct FusedGradient {
+  Dtype scale;
+  Dtype decay;
+  bool l1;
+
+  inline Dtype operator()(Dtype data, Dtype diff) const {
+    Dtype g = scale * diff;
+    if (decay) {
+      g += decay * (l1 ? Dtype(caffe_sign(data)) : data);
+    }
+    return g;
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,6 +53,24 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // Fused CPU update path, enabled by SolverParameter.fused_update.
+  void InitFusedUpdate();
+  void ApplyFusedUpdate(Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
+  inline Dtype* fused_data(int param_id) {
+    return static_cast<Dtype*>(fused_data_->mutable_cpu_data()) +
+        fused_offset_[param_id];
+  }
+  inline Dtype* fused_diff(int param_id) {
+    return static_cast<Dtype*>(fused_diff_->mutable_cpu_data()) +
+        fused_offset_[param_id];
+  }
+  // The history blob slot * num_params + param_id.
+  inline Dtype* fused_history(int slot, int param_id) {
+    return static_cast<Dtype*>(fused_history_->mutable_cpu_data()) +
+        slot * fused_count_ + fused_offset_[param_id];
+  }
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -41,6 +81,11 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // Contiguous storage backing the learnable params' data and diff and the
+  // history blobs when the fused update is enabled.
+  shared_ptr<SyncedMemory> fused_data_, fused_diff_, fused_history_;
+  vector<size_t> fused_offset_;
+  size_t fused_count_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +101,8 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +118,8 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +140,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +166,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +192,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdateValue(int param_id, Dtype rate,
+      const FusedGradient<Dtype>& grad);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -6,6 +6,7 @@
 
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -100,6 +101,15 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  // Writes a snapshot file with the given writer: directly, or on the
+  // background snapshot thread with snapshot_async, in which case the writer
+  // must only use data staged by the caller.
+  void WriteSnapshotFile(const string& filename,
+      const SnapshotWriter::FileWriter& writer);
+  // Copies blobs to host memory that the snapshot thread can read while
+  // training continues.
+  static vector<shared_ptr<Blob<Dtype> > > StageBlobs(
+      const vector<shared_ptr<Blob<Dtype> > >& blobs, bool copy_diff);
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
@@ -129,6 +139,9 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Background writer for asynchronous snapshots (root solver only).
+  shared_ptr<SnapshotWriter> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -0,0 +1,66 @@
+#ifndef CAFFE_UTIL_CONV_ALGORITHM_CACHE_HPP_
+#define CAFFE_UTIL_CONV_ALGORITHM_CACHE_HPP_
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Remembers the fastest CPU convolution algorithm found by autotuning
+ *        (ConvolutionParameter.cpu_algorithm == AUTOTUNE) for each host and
+ *        layer geometry.
+ *
+ * The choices are kept in memory and appended to a cache file, one per line,
+ * so that later runs on the same host reuse them instead of timing the
+ * algorithms again. Keys start with HostKey(), as the fastest algorithm
+ * depends on the CPU and the number of BLAS threads.
+ */
+class ConvAlgorithmCache {
+ public:
+  struct Choice {
+    Choice() : algorithm(0), gemm_batch(1), microseconds(0) {}
+    /// @brief A ConvolutionParameter::CPUAlgorithm other than AUTOTUNE.
+    int algorithm;
+    /// @brief The images to lower at once for GEMM.
+    int gemm_batch;
+    /// @brief The time measured for one pass, for reference.
+    float microseconds;
+  };
+
+  /// @brief Uses no cache file until set_path is called.
+  ConvAlgorithmCache();
+  /// @brief The cache of the process, in ~/.caffe/conv_algorithms.tsv unless
+  ///        set_path changes it.
+  static ConvAlgorithmCache* Get();
+  /// @brief The CPU model and the number of BLAS threads.
+  static string HostKey();
+
+  /// @brief Replaces the choices with those in path, and appends new ones to
+  ///        it (creating it as needed). An empty path keeps them in memory
+  ///        only.
+  void set_path(const string& path);
+  string path() const;
+  bool Lookup(const string& key, Choice* choice) const;
+  void Insert(const string& key, const Choice& choice);
+  int size() const;
+
+ protected:
+  string path_;
+  std::map<string, Choice> choices_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(ConvAlgorithmCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONV_ALGORITHM_CACHE_HPP_
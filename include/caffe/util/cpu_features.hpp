@@ -0,0 +1,127 @@
+#ifndef CAFFE_UTIL_CPU_FEATURES_HPP_
+#define CAFFE_UTIL_CPU_FEATURES_HPP_
+
+namespace caffe {
+
+// The instruction sets the CPU kernels are compiled for, in increasing order.
+// Each includes the ones before it.
+enum CPUISA {
+  CPU_ISA_GENERIC = 0,  // What the build targets, SSE2 on x86-64.
+  CPU_ISA_SSE4 = 1,     // SSE4.1.
+  CPU_ISA_AVX2 = 2,     // AVX2 and FMA.
+  CPU_ISA_AVX512 = 3    // AVX-512F and FMA.
+};
+
+// The best of the instruction sets above that the host and its OS support.
+CPUISA DetectCPUISA();
+
+// The instruction set the kernels dispatch to: the detected one, lowered by
+// the CAFFE_CPU_ISA environment variable if set to the name of a lower one.
+CPUISA cpu_isa();
+// Changes it for the whole process, to at most DetectCPUISA().
+void set_cpu_isa(CPUISA isa);
+
+// "generic", "sse4", "avx2" or "avx512".
+const char* CPUISAName(CPUISA isa);
+
+// Multi-versioned kernels: where the compiler supports target attributes,
+// each kernel is compiled once per instruction set into the same binary.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(__CUDACC__)
+#define CAFFE_MULTI_ISA
+#define CAFFE_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define CAFFE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define CAFFE_TARGET_AVX512 __attribute__((target("avx512f,fma")))
+// Inlines everything the kernel calls, so that it is all compiled for the
+// kernel's instruction set.
+#define CAFFE_CPU_KERNEL __attribute__((flatten))
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_SSE4
+void cpu_for_sse4(const int n, const Op& op) {
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_AVX2
+void cpu_for_avx2(const int n, const Op& op) {
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_AVX512
+void cpu_for_avx512(const int n, const Op& op) {
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_SSE4
+void cpu_parallel_for_sse4(const int n, const Op& op) {
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_AVX2
+void cpu_parallel_for_avx2(const int n, const Op& op) {
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+template <typename Op>
+CAFFE_CPU_KERNEL CAFFE_TARGET_AVX512
+void cpu_parallel_for_avx512(const int n, const Op& op) {
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+#endif  // CAFFE_MULTI_ISA
+
+// Calls op(i) for i in [0, n), in a loop compiled for cpu_isa() with op
+// inlined into it. op is a functor with an `void operator()(int i) const`;
+// both its loops and the loop over i get vectorized for the instruction set.
+template <typename Op>
+inline void cpu_dispatch_for(const int n, const Op& op) {
+#ifdef CAFFE_MULTI_ISA
+  switch (cpu_isa()) {
+  case CPU_ISA_AVX512:
+    cpu_for_avx512(n, op);
+    return;
+  case CPU_ISA_AVX2:
+    cpu_for_avx2(n, op);
+    return;
+  case CPU_ISA_SSE4:
+    cpu_for_sse4(n, op);
+    return;
+  default:
+    break;
+  }
+#endif
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+// As cpu_dispatch_for, with the iterations split among the OpenMP threads in
+// builds with OpenMP. Each op(i) must only write what no other i touches.
+template <typename Op>
+inline void cpu_parallel_dispatch_for(const int n, const Op& op) {
+#ifdef CAFFE_MULTI_ISA
+  switch (cpu_isa()) {
+  case CPU_ISA_AVX512:
+    cpu_parallel_for_avx512(n, op);
+    return;
+  case CPU_ISA_AVX2:
+    cpu_parallel_for_avx2(n, op);
+    return;
+  case CPU_ISA_SSE4:
+    cpu_parallel_for_sse4(n, op);
+    return;
+  default:
+    break;
+  }
+#endif
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i) { op(i); }
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_FEATURES_HPP_
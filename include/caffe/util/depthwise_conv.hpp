@@ -0,0 +1,35 @@
+#ifndef CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+#define CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+
+namespace caffe {
+
+// Direct 2D convolution of each of the channels of an image with its own
+// multiplier filters, as in a convolution with group == channels. Output
+// channel c * multiplier + m is channel c convolved with filter
+// c * multiplier + m of weights (kernel_h x kernel_w each).
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weights, Dtype* data_out);
+
+// The gradient w.r.t. the image, which is overwritten.
+template <typename Dtype>
+void depthwise_conv_backward_cpu(const Dtype* diff_out, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weights, Dtype* diff_im);
+
+// The gradient w.r.t. the weights, which is accumulated.
+template <typename Dtype>
+void depthwise_conv_weight_cpu(const Dtype* data_im, const Dtype* diff_out,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, Dtype* diff_weights);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DEPTHWISE_CONV_HPP_
@@ -13,6 +13,25 @@ inline std::string format_int(int n, int numberOfLeadingZeros = 0 ) {
   return s.str();
 }
 
+// Quotes s as a JSON string.
+inline std::string format_json_string(const std::string& s) {
+  std::string quoted = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    if (static_cast<unsigned char>(s[i]) < 0x20) {
+      std::ostringstream escaped;
+      escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+              << static_cast<int>(s[i]);
+      quoted += escaped.str();
+      continue;
+    }
+    if (s[i] == '"' || s[i] == '\\') {
+      quoted += '\\';
+    }
+    quoted += s[i];
+  }
+  return quoted + "\"";
 }
 
+}  // namespace caffe
+
 #endif   // CAFFE_UTIL_FORMAT_H_
@@ -0,0 +1,118 @@
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Allocates the host memory of SyncedMemory, unless it is pinned for
+ *        CUDA.
+ *
+ * The allocator in use can be replaced with Set; memory is always freed by
+ * the allocator that allocated it, and allocators are kept alive for that.
+ */
+class HostAllocator {
+ public:
+  virtual ~HostAllocator() {}
+  virtual void* Allocate(size_t size) = 0;
+  /// @brief Frees ptr, returned by Allocate(size).
+  virtual void Free(void* ptr, size_t size) = 0;
+
+  /// @brief The allocator in use, an AlignedAllocator by default.
+  static HostAllocator* Get();
+  /// @brief Uses allocator from now on, or the default one if NULL.
+  static void Set(const shared_ptr<HostAllocator>& allocator);
+};
+
+/**
+ * @brief Allocates memory aligned for SIMD loads (to cache lines by
+ *        default), optionally backing large blocks with huge pages to reduce
+ *        TLB misses.
+ *
+ * With TRANSPARENT huge pages, blocks of at least huge_page_size are aligned
+ * to it and advised to be backed by transparent huge pages. With EXPLICIT
+ * huge pages, they are mapped from the reserved huge pages
+ * (/proc/sys/vm/nr_hugepages), falling back to aligned memory when none are
+ * left. Huge pages are only available on Linux.
+ */
+class AlignedAllocator : public HostAllocator {
+ public:
+  enum HugePages { NONE, TRANSPARENT, EXPLICIT };
+  explicit AlignedAllocator(size_t alignment = 64,
+      HugePages huge_pages = NONE, size_t huge_page_size = 2 << 20);
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr, size_t size);
+
+ protected:
+  bool huge(size_t size) const {
+    return huge_pages_ != NONE && size >= huge_page_size_;
+  }
+  size_t RoundToHugePages(size_t size) const {
+    return (size + huge_page_size_ - 1) / huge_page_size_ * huge_page_size_;
+  }
+
+  size_t alignment_;
+  HugePages huge_pages_;
+  size_t huge_page_size_;
+  // The blocks mapped from explicit huge pages.
+  std::map<void*, size_t> mapped_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(AlignedAllocator);
+};
+
+/**
+ * @brief Caches the blocks freed into another allocator by size class, and
+ *        reuses them for allocations of the same class.
+ *
+ * This makes repeated Blob::Reshape of variable-size inputs cheap. Sizes are
+ * rounded up to a class of at most 25% more, and at most max_cached_bytes
+ * are kept cached.
+ */
+class PoolingAllocator : public HostAllocator {
+ public:
+  PoolingAllocator(const shared_ptr<HostAllocator>& base,
+      size_t max_cached_bytes);
+  virtual ~PoolingAllocator();
+  virtual void* Allocate(size_t size);
+  virtual void Free(void* ptr, size_t size);
+
+  /// @brief Frees the cached blocks into the base allocator.
+  void Trim();
+  size_t cached_bytes() const;
+  /// @brief The number of allocations served from the cache.
+  size_t hits() const;
+  size_t misses() const;
+
+  /// @brief The size class of size: 64 bytes, or a quarter step between two
+  ///        powers of two.
+  static size_t SizeClass(size_t size);
+
+ protected:
+  shared_ptr<HostAllocator> base_;
+  size_t max_cached_bytes_;
+  size_t cached_bytes_;
+  size_t hits_;
+  size_t misses_;
+  std::map<size_t, vector<void*> > cache_;
+
+  class sync;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(PoolingAllocator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
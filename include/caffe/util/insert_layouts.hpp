@@ -0,0 +1,21 @@
+#ifndef CAFFE_UTIL_INSERT_LAYOUTS_HPP_
+#define CAFFE_UTIL_INSERT_LAYOUTS_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters, running the layers that support it channels-last when
+// internal_layout is NHWC: 1x1 convolutions always do (with layout NHWC), and
+// elementwise layers do when their bottoms are only available in NHWC. Layout
+// layers are added to convert blobs at the boundaries, so that the other
+// layers and the outputs of the net still see NCHW data under the original
+// blob names.
+void InsertLayouts(const NetParameter& param, NetParameter* param_layouts);
+
+// Whether a ConvolutionLayer with this configuration supports layout NHWC.
+bool SupportsChannelsLast(const ConvolutionParameter& conv_param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INSERT_LAYOUTS_HPP_
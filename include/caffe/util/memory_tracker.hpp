@@ -0,0 +1,110 @@
+#ifndef CAFFE_UTIL_MEMORY_TRACKER_HPP_
+#define CAFFE_UTIL_MEMORY_TRACKER_HPP_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Accounts the host memory allocated by SyncedMemory to its owner
+ *        (a layer, a data layer's prefetch queue or the solver) and kind,
+ *        tracking the live and peak bytes of each and in total.
+ *
+ * A SyncedMemory is charged to the account of the innermost Scope that was
+ * active on its thread when it was created, or to an account with an empty
+ * owner outside any scope. It can be moved to another account later, and then
+ * counts toward the peaks of both (e.g. the weights of a layer are created as
+ * its data, then moved to its params). The peaks can be reset, e.g. by
+ * monitoring that samples the usage over time.
+ */
+class MemoryTracker {
+ public:
+  enum Kind {
+    DATA,  // layer outputs and internal buffers
+    DIFF,  // their gradients
+    PARAMS,  // learnable parameters and their gradients
+    COL_BUFFER,  // im2col buffers of convolutions
+    SOLVER_HISTORY,
+    PREFETCH,  // batches being loaded by data layers
+    OTHER,
+    NUM_KINDS
+  };
+  static const char* kind_name(int kind);
+
+  struct Account {
+    Account() : kind(OTHER), live_bytes(0), peak_bytes(0), allocations(0) {}
+    string owner;
+    Kind kind;
+    size_t live_bytes;
+    size_t peak_bytes;
+    /// The number of live allocations.
+    int allocations;
+  };
+
+  /// @brief Charges the memory created on this thread while in scope.
+  class Scope {
+   public:
+    Scope(const string& owner, Kind kind);
+    explicit Scope(Account* account);
+    ~Scope();
+
+   private:
+    Account* previous_;
+
+  DISABLE_COPY_AND_ASSIGN(Scope);
+  };
+
+  static MemoryTracker* Get();
+
+  /// @brief The account of owner and kind, created on first use.
+  Account* account(const string& owner, Kind kind);
+  /// @brief The account of the innermost Scope on this thread.
+  Account* current();
+  /// @brief The account charged with the diff of a blob whose data is
+  ///        charged to account: DIFF for DATA, the same otherwise.
+  Account* diff_account(Account* account);
+
+  void Allocate(Account* account, size_t bytes);
+  void Free(Account* account, size_t bytes);
+  void Move(Account* from, Account* to, size_t bytes);
+
+  size_t live_bytes() const;
+  size_t peak_bytes() const;
+  size_t live_bytes(Kind kind) const;
+  size_t peak_bytes(Kind kind) const;
+  /// @brief Copies of all accounts, by decreasing peak bytes.
+  vector<Account> accounts() const;
+  /// @brief Resets the peaks to the live bytes.
+  void ResetPeaks();
+  /// @brief Logs the live and peak bytes in total and by kind, and the
+  ///        accounts with the highest peaks.
+  void LogReport(int top_accounts) const;
+
+ protected:
+  MemoryTracker();
+
+  size_t live_bytes_;
+  size_t peak_bytes_;
+  vector<size_t> kind_live_bytes_;
+  vector<size_t> kind_peak_bytes_;
+  Account* untracked_;
+  std::map<std::pair<string, int>, Account> accounts_;
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(MemoryTracker);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MEMORY_TRACKER_HPP_
@@ -17,15 +17,26 @@ extern "C" {
 
 #include <math.h>
 
+#include "caffe/util/cpu_features.hpp"
+#include "caffe/util/vector_math.hpp"
+
 // Functions that caffe uses but are not present if MKL is not linked.
 
 // A simple way to define the vsl unary functions. The operation should
-// be in the form e.g. y[i] = sqrt(a[i])
+// be in the form e.g. y[i] = sqrt(a[i]), and runs in a loop compiled for
+// the instruction set of the CPU.
 #define DEFINE_VSL_UNARY_FUNC(name, operation) \
+  template<typename Dtype> \
+  struct v##name##Op { \
+    const Dtype* a; \
+    Dtype* y; \
+    void operator()(const int i) const { operation; } \
+  }; \
   template<typename Dtype> \
   void v##name(const int n, const Dtype* a, Dtype* y) { \
     CHECK_GT(n, 0); CHECK(a); CHECK(y); \
-    for (int i = 0; i < n; ++i) { operation; } \
+    const v##name##Op<Dtype> op = {a, y}; \
+    caffe::cpu_dispatch_for(n, op); \
   } \
   inline void vs##name( \
     const int n, const float* a, float* y) { \
@@ -37,10 +48,30 @@ extern "C" {
   }
 
 DEFINE_VSL_UNARY_FUNC(Sqr, y[i] = a[i] * a[i]);
-DEFINE_VSL_UNARY_FUNC(Exp, y[i] = exp(a[i]));
-DEFINE_VSL_UNARY_FUNC(Ln, y[i] = log(a[i]));
 DEFINE_VSL_UNARY_FUNC(Abs, y[i] = fabs(a[i]));
 
+// The transcendental functions in single precision use the vectorized ones
+// of vector_math.hpp in place of the libm calls of the operation.
+#define DEFINE_VSL_UNARY_FUNC_VECTORIZED(name, operation, vector_function) \
+  template<typename Dtype> \
+  void v##name(const int n, const Dtype* a, Dtype* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    for (int i = 0; i < n; ++i) { operation; } \
+  } \
+  inline void vs##name( \
+    const int n, const float* a, float* y) { \
+    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
+    caffe::vector_function(n, a, y); \
+  } \
+  inline void vd##name( \
+      const int n, const double* a, double* y) { \
+    v##name<double>(n, a, y); \
+  }
+
+DEFINE_VSL_UNARY_FUNC_VECTORIZED(Exp, y[i] = exp(a[i]), vector_exp);
+DEFINE_VSL_UNARY_FUNC_VECTORIZED(Ln, y[i] = log(a[i]), vector_log);
+DEFINE_VSL_UNARY_FUNC_VECTORIZED(Tanh, y[i] = tanh(a[i]), vector_tanh);
+
 // A simple way to define the vsl unary functions with singular parameter b.
 // The operation should be in the form e.g. y[i] = pow(a[i], b)
 #define DEFINE_VSL_UNARY_FUNC_WITH_PARAM(name, operation) \
@@ -49,24 +80,32 @@ DEFINE_VSL_UNARY_FUNC(Abs, y[i] = fabs(a[i]));
     CHECK_GT(n, 0); CHECK(a); CHECK(y); \
     for (int i = 0; i < n; ++i) { operation; } \
   } \
-  inline void vs##name( \
-    const int n, const float* a, const float b, float* y) { \
-    v##name<float>(n, a, b, y); \
-  } \
   inline void vd##name( \
       const int n, const double* a, const float b, double* y) { \
     v##name<double>(n, a, b, y); \
   }
 
 DEFINE_VSL_UNARY_FUNC_WITH_PARAM(Powx, y[i] = pow(a[i], b));
+inline void vsPowx(const int n, const float* a, const float b, float* y) {
+  CHECK_GT(n, 0); CHECK(a); CHECK(y);
+  caffe::vector_powx(n, a, b, y);
+}
 
 // A simple way to define the vsl binary functions. The operation should
-// be in the form e.g. y[i] = a[i] + b[i]
+// be in the form e.g. y[i] = a[i] + b[i], and runs like the unary ones.
 #define DEFINE_VSL_BINARY_FUNC(name, operation) \
+  template<typename Dtype> \
+  struct v##name##Op { \
+    const Dtype* a; \
+    const Dtype* b; \
+    Dtype* y; \
+    void operator()(const int i) const { operation; } \
+  }; \
   template<typename Dtype> \
   void v##name(const int n, const Dtype* a, const Dtype* b, Dtype* y) { \
     CHECK_GT(n, 0); CHECK(a); CHECK(b); CHECK(y); \
-    for (int i = 0; i < n; ++i) { operation; } \
+    const v##name##Op<Dtype> op = {a, b, y}; \
+    caffe::cpu_dispatch_for(n, op); \
   } \
   inline void vs##name( \
     const int n, const float* a, const float* b, float* y) { \
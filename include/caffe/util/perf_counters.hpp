@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_PERF_COUNTERS_HPP_
+#define CAFFE_UTIL_PERF_COUNTERS_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The performance counters of the calling thread, read through Linux
+ *        perf_event_open.
+ *
+ * Each counter is opened on its own, so those the kernel or the hardware do
+ * not provide (e.g. hardware counters in most virtual machines) are simply
+ * unavailable; on other systems none are.
+ */
+class PerfCounters {
+ public:
+  enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_REFERENCES,
+    CACHE_MISSES,  // last level cache misses
+    BRANCH_MISSES,
+    PAGE_FAULTS,
+    NUM_COUNTERS
+  };
+  static const char* name(int counter);
+
+  /// @brief The counters of the calling thread, opened on first use.
+  static PerfCounters* ForThread();
+  ~PerfCounters();
+
+  bool available(int counter) const { return fds_[counter] >= 0; }
+  bool any_available() const;
+  /**
+   * @brief Reads the counts since the counters were opened, scaled for the
+   *        time they were not running; unavailable counters read 0.
+   */
+  void Read(vector<uint64_t>* values) const;
+
+ protected:
+  PerfCounters();
+
+  vector<int> fds_;
+
+DISABLE_COPY_AND_ASSIGN(PerfCounters);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PERF_COUNTERS_HPP_
@@ -0,0 +1,44 @@
+#ifndef _CAFFE_UTIL_POOLING_HPP_
+#define _CAFFE_UTIL_POOLING_HPP_
+
+namespace caffe {
+
+// Pooling of num height x width planes into pooled_height x pooled_width
+// planes, over the windows PoolingLayer uses: window (ph, pw) starts at
+// (ph * stride_h - pad_h, pw * stride_w - pad_w) and is clipped to the
+// plane. The planes run in parallel, and the windows inside the plane are
+// vectorized along the rows, with 2x2 and 3x3 windows of stride 2 and
+// global pooling specialized.
+
+// With mask non-NULL, also writes the index in its plane of the first
+// maximum of each window, for max_pool_backward_cpu.
+template <typename Dtype>
+void max_pool_cpu(const Dtype* data, const int num, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* pooled,
+    int* mask);
+
+// Averages over the windows counting the padding, but not the part of the
+// windows past it.
+template <typename Dtype>
+void ave_pool_cpu(const Dtype* data, const int num, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* pooled);
+
+// The backward passes add the gradients into diff.
+template <typename Dtype>
+void max_pool_backward_cpu(const Dtype* pooled_diff, const int* mask,
+    const int num, const int height, const int width,
+    const int pooled_height, const int pooled_width, Dtype* diff);
+
+template <typename Dtype>
+void ave_pool_backward_cpu(const Dtype* pooled_diff, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* diff);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_POOLING_HPP_
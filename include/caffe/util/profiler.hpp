@@ -0,0 +1,111 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <map>
+#include <ostream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Collects the run time, FLOPs and bytes moved of each layer from
+ *        Layer::Forward and Layer::Backward while enabled.
+ *
+ * The report gives latency percentiles, the achieved GFLOP/s and GB/s, and,
+ * given the peak compute and memory bandwidth of the host, whether each layer
+ * is compute-bound or bandwidth-bound and how close it gets to the roofline.
+ * Layers are identified by name and type, so layers shared by several nets
+ * (e.g. the train and test nets) are reported together. Optionally, the
+ * PerfCounters of the thread running each layer are read as well, to report
+ * instructions per cycle and cache miss rates.
+ */
+class Profiler {
+ public:
+  /// @brief The measurements of one layer in one direction.
+  struct Pass {
+    Pass() : flops(0), bytes(0) {}
+    /// The run time of each call.
+    vector<float> microseconds;
+    /// FLOPs and bytes read and written, summed over the calls.
+    double flops;
+    double bytes;
+    /// The PerfCounters summed over the calls, -1 for unavailable ones, or
+    /// empty if they were not read.
+    vector<double> counters;
+  };
+  struct LayerProfile {
+    LayerProfile() : top_bytes(0), param_bytes(0) {}
+    string name;
+    string type;
+    /// The shape of the first bottom (or top) in the last call.
+    string shape;
+    Pass forward;
+    Pass backward;
+    /// The memory footprint of the tops, at the largest shapes seen, and of
+    /// the parameters.
+    double top_bytes;
+    double param_bytes;
+  };
+
+  static Profiler* Get();
+  static bool enabled() { return enabled_; }
+  static void set_enabled(bool value) { enabled_ = value; }
+  /// @brief Whether to read the PerfCounters around each call.
+  static bool counters_enabled() { return counters_enabled_; }
+  static void set_counters_enabled(bool value) { counters_enabled_ = value; }
+
+  /**
+   * @brief Adds a call of a layer; may be called from several threads.
+   *
+   * counters holds the change in each of the PerfCounters, -1 if the counter
+   * is unavailable, or is empty if they were not read.
+   */
+  void Record(const string& name, const string& type, const string& shape,
+      bool backward, float microseconds, double flops, double bytes,
+      double top_bytes, double param_bytes, const vector<double>& counters);
+  void Clear();
+  /// @brief The profiles of the layers, in the order they were first run.
+  vector<LayerProfile> profiles() const;
+
+  /**
+   * @brief Sets the roofline of the host: its peak GFLOP/s and GB/s. Layers
+   *        are not classified when these are 0.
+   */
+  void set_peak(double gflops, double gbps);
+
+  void WriteJSON(std::ostream* out) const;
+  void WriteCSV(std::ostream* out) const;
+  /// @brief Writes the report as CSV if filename ends in .csv, else as JSON.
+  void Write(const string& filename) const;
+  /// @brief Logs a summary of the report, one line per layer and direction.
+  void LogSummary() const;
+
+  /// @brief Returns the p-th percentile (0 to 100) of values.
+  static float Percentile(vector<float> values, double p);
+
+ protected:
+  Profiler();
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  static bool enabled_;
+  static bool counters_enabled_;
+  shared_ptr<sync> sync_;
+  vector<LayerProfile> profiles_;
+  map<string, int> index_;
+  double peak_gflops_;
+  double peak_gbps_;
+
+DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
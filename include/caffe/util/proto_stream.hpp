@@ -0,0 +1,128 @@
+#ifndef CAFFE_UTIL_PROTO_STREAM_HPP_
+#define CAFFE_UTIL_PROTO_STREAM_HPP_
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/message.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+using ::google::protobuf::Message;
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::FileInputStream;
+using ::google::protobuf::io::FileOutputStream;
+
+/**
+ * @brief Writes a binary proto file one field at a time.
+ *
+ * Blob contents are copied straight from the blob into the file in the
+ * BlobProto wire format, so messages holding large blobs (e.g. a NetParameter
+ * with all the weights of a net) never have to be built in memory, and are
+ * not subject to the 2GB limit on serialized messages.
+ */
+class ProtoStreamWriter {
+ public:
+  explicit ProtoStreamWriter(const string& filename);
+  ~ProtoStreamWriter();
+
+  /// @brief Appends the fields set in message.
+  void WriteFields(const Message& message);
+  /**
+   * @brief Starts the length-delimited (message) field field_number; the size
+   *        bytes of its contents must be written next.
+   */
+  void WriteLengthDelimited(int field_number, uint64_t size);
+  /// @brief Appends blob as the BlobProto field field_number.
+  template <typename Dtype>
+  void WriteBlob(int field_number, const Blob<Dtype>& blob, bool write_diff);
+  /// @brief Flushes and closes the file.
+  void Close();
+
+  /// @brief Returns the serialized size of the fields set in message.
+  static uint64_t FieldsSize(const Message& message);
+  /// @brief Returns the size of a length-delimited field with size bytes.
+  static uint64_t LengthDelimitedSize(int field_number, uint64_t size);
+  /// @brief Returns the size of the BlobProto field written by WriteBlob.
+  template <typename Dtype>
+  static uint64_t BlobSize(int field_number, const Blob<Dtype>& blob,
+      bool write_diff);
+
+ protected:
+  CodedOutputStream* coded();
+  void WriteRaw(const void* data, uint64_t size);
+
+  const string filename_;
+  shared_ptr<FileOutputStream> raw_output_;
+  shared_ptr<CodedOutputStream> coded_output_;
+
+DISABLE_COPY_AND_ASSIGN(ProtoStreamWriter);
+};
+
+/**
+ * @brief Reads a binary proto file one field at a time.
+ *
+ * The counterpart of ProtoStreamWriter: BlobProto fields are read straight
+ * into existing blobs. Message boundaries are tracked as absolute file
+ * positions, so files larger than 2GB can be read.
+ */
+class ProtoStreamReader {
+ public:
+  explicit ProtoStreamReader(const string& filename);
+  ~ProtoStreamReader();
+
+  /**
+   * @brief Reads the tag of the next field of the message ending at position
+   *        end (or at the end of the file if end < 0).
+   *
+   * Returns false once the message is exhausted. Otherwise the field must be
+   * consumed by one of the Read or Skip methods below.
+   */
+  bool NextField(int64_t end, int* field_number);
+  /// @brief Skips the current field.
+  void SkipField();
+  /// @brief Reads an int32 field.
+  int ReadInt32();
+  /// @brief Reads a string field.
+  string ReadString();
+  /// @brief Reads the length of a message field and returns its end position.
+  int64_t ReadMessageEnd();
+  /**
+   * @brief Reads a BlobProto field into blob.
+   *
+   * The data (and diff, if present) are copied into blob if they have
+   * exactly blob->count() elements, and skipped otherwise; the remaining
+   * fields are returned in header so the caller can check the shape.
+   * Returns whether the data were copied.
+   */
+  template <typename Dtype>
+  bool ReadBlob(Blob<Dtype>* blob, BlobProto* header);
+  /// @brief The number of bytes read so far.
+  int64_t position() const;
+
+ protected:
+  CodedInputStream* coded();
+  void Skip(uint64_t size);
+  template <typename Stype, typename Dtype>
+  void ReadValues(int64_t capacity, int64_t* count, Dtype* values);
+
+  const string filename_;
+  int fd_;
+  shared_ptr<FileInputStream> raw_input_;
+  shared_ptr<CodedInputStream> coded_input_;
+  int64_t consumed_;
+  uint32_t tag_;
+
+DISABLE_COPY_AND_ASSIGN(ProtoStreamReader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROTO_STREAM_HPP_
@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <boost/function.hpp>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Writes snapshot files on a background thread.
+ *
+ * Writers only touch data that the solver staged before queueing them, so
+ * training continues as soon as Write() returns. Each file is written under a
+ * temporary name, synced to disk and then renamed into place, so a crash never
+ * leaves a truncated snapshot behind.
+ */
+class SnapshotWriter : public InternalThread {
+ public:
+  // Writes the snapshot contents to the given (temporary) filename.
+  typedef boost::function<void(const string&)> FileWriter;
+
+  SnapshotWriter();
+  virtual ~SnapshotWriter();
+
+  /// @brief Queues writing filename with writer.
+  void Write(const string& filename, const FileWriter& writer);
+  /// @brief Blocks until all queued files are on disk.
+  void Wait();
+
+  struct Task {
+    string filename;
+    FileWriter writer;
+  };
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  BlockingQueue<shared_ptr<Task> > pending_;
+  BlockingQueue<shared_ptr<Task> > done_;
+  int num_pending_;
+
+DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+/// @brief Flushes filename to disk and atomically renames it to new_filename.
+void SyncAndRenameFile(const string& filename, const string& new_filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
@@ -0,0 +1,70 @@
+#ifndef CAFFE_UTIL_TASK_SCHEDULER_HPP_
+#define CAFFE_UTIL_TASK_SCHEDULER_HPP_
+
+#include <boost/function.hpp>
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Runs a graph of dependent tasks on a pool of worker threads.
+ *
+ * The thread calling Run takes part in the work, and is the only one to run
+ * the tasks marked on_caller, e.g. those using Caffe's thread local state.
+ * The workers are kept between runs.
+ */
+class TaskScheduler {
+ public:
+  typedef boost::function<void(int)> Task;
+
+  /// @brief Starts num_threads workers, in addition to the calling thread.
+  explicit TaskScheduler(int num_threads);
+  ~TaskScheduler();
+
+  /**
+   * @brief Runs task(i) for each i in [0, successors.size()), and returns
+   *        when all have finished.
+   *
+   * A task starts once every task listing it in its successors has finished;
+   * the graph must be acyclic.
+   */
+  void Run(const vector<vector<int> >& successors,
+      const vector<bool>& on_caller, const Task& task);
+
+  int num_threads() const { return threads_.size(); }
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void WorkerEntry();
+  // Marks task_id finished and queues the successors now ready. Must be
+  // called with the lock held.
+  void Finish(int task_id);
+  void Queue(int task_id);
+
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > threads_;
+  const vector<vector<int> >* successors_;
+  const vector<bool>* on_caller_;
+  const Task* task_;
+  vector<int> num_predecessors_;
+  std::deque<int> ready_;
+  std::deque<int> caller_ready_;
+  int num_pending_;
+  bool stop_;
+
+DISABLE_COPY_AND_ASSIGN(TaskScheduler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_SCHEDULER_HPP_
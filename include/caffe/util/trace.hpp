@@ -0,0 +1,74 @@
+#ifndef CAFFE_UTIL_TRACE_HPP_
+#define CAFFE_UTIL_TRACE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Records spans of work on all threads while enabled, and writes them
+ *        as a Chrome trace (for chrome://tracing or Perfetto).
+ *
+ * Each thread appends to its own buffer, so threads do not contend when
+ * recording; while tracing is disabled a TraceSpan only reads a flag.
+ */
+class Tracer {
+ public:
+  /// @brief Clears the recorded events and starts tracing.
+  static void Start();
+  /// @brief Stops tracing; the events are kept until the next Start.
+  static void Stop();
+  static bool enabled() { return enabled_; }
+  /// @brief Writes the recorded events as a Chrome trace JSON file.
+  static void Write(const string& filename);
+
+  /// @brief Names the calling thread in the trace; may be called any time.
+  static void SetThreadName(const string& name);
+  /// @brief The microseconds since tracing started.
+  static int64_t Now();
+  /// @brief Records a span from start to end on the calling thread.
+  static void Record(const string& name, const char* category, int64_t start,
+      int64_t end);
+
+ protected:
+  static bool enabled_;
+};
+
+/// @brief Records a span from its construction to its destruction.
+class TraceSpan {
+ public:
+  TraceSpan(const char* name, const char* category)
+      : category_(Tracer::enabled() ? category : NULL), start_(0) {
+    if (category_) {
+      name_ = name;
+      start_ = Tracer::Now();
+    }
+  }
+  TraceSpan(const string& name, const char* category)
+      : category_(Tracer::enabled() ? category : NULL), start_(0) {
+    if (category_) {
+      name_ = name;
+      start_ = Tracer::Now();
+    }
+  }
+  ~TraceSpan() {
+    if (category_) {
+      Tracer::Record(name_, category_, start_, Tracer::Now());
+    }
+  }
+
+ private:
+  string name_;
+  const char* category_;
+  int64_t start_;
+
+DISABLE_COPY_AND_ASSIGN(TraceSpan);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRACE_HPP_
@@ -134,9 +134,7 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
 }
 
 void Net_Save(const Net<Dtype>& net, string filename) {
-  NetParameter net_param;
-  net.ToProto(&net_param, false);
-  WriteProtoToBinaryFile(net_param, filename.c_str());
+  net.ToBinaryProto(filename, false);
 }
 
 void Net_SaveHDF5(const Net<Dtype>& net, string filename) {
@@ -5,6 +5,7 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_features.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -53,7 +54,10 @@ void GlobalInit(int* pargc, char*** pargv) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), root_solver_(true) {
+  // Pick the instruction set of the CPU kernels up front.
+  cpu_isa();
+}
 
 Caffe::~Caffe() { }
 
@@ -119,6 +123,8 @@ Caffe::Caffe()
       != CURAND_STATUS_SUCCESS) {
     LOG(ERROR) << "Cannot create Curand generator. Curand won't be available.";
   }
+  // Pick the instruction set of the CPU kernels up front.
+  cpu_isa();
 }
 
 Caffe::~Caffe() {
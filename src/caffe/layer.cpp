@@ -1,5 +1,10 @@
 #include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
 #include "caffe/layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/perf_counters.hpp"
 
 namespace caffe {
 
@@ -22,6 +27,91 @@ void Layer<Dtype>::Unlock() {
   }
 }
 
+template <typename Dtype>
+double Layer<Dtype>::ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  double flops = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    flops += top[i]->count();
+  }
+  return flops;
+}
+
+template <typename Dtype>
+double Layer<Dtype>::BackwardFlops(const vector<Blob<Dtype>*>& top,
+    const vector<Blob<Dtype>*>& bottom) const {
+  double flops = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    flops += bottom[i]->count();
+  }
+  return flops;
+}
+
+template <typename Dtype>
+double Layer<Dtype>::ForwardBytes(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) const {
+  double count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    count += bottom[i]->count();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    count += top[i]->count();
+  }
+  for (int i = 0; i < blobs_.size(); ++i) {
+    count += blobs_[i]->count();
+  }
+  return count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+double Layer<Dtype>::BackwardBytes(const vector<Blob<Dtype>*>& top,
+    const vector<Blob<Dtype>*>& bottom) const {
+  return 2 * ForwardBytes(bottom, top);
+}
+
+template <typename Dtype>
+void Layer<Dtype>::StartProfile() {
+  if (!profile_timer_) {
+    profile_timer_.reset(new Timer());
+  }
+  if (Profiler::counters_enabled()) {
+    PerfCounters::ForThread()->Read(&profile_counters_);
+  }
+  profile_timer_->Start();
+}
+
+template <typename Dtype>
+void Layer<Dtype>::StopProfile(bool backward,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const float microseconds = profile_timer_->MicroSeconds();
+  vector<double> counters;
+  if (Profiler::counters_enabled()) {
+    const PerfCounters* perf_counters = PerfCounters::ForThread();
+    vector<uint64_t> values;
+    perf_counters->Read(&values);
+    for (int i = 0; i < values.size(); ++i) {
+      counters.push_back(perf_counters->available(i) ?
+          static_cast<double>(values[i] - profile_counters_[i]) : -1);
+    }
+  }
+  const Blob<Dtype>* shape_blob = !bottom.empty() ? bottom[0] :
+      (!top.empty() ? top[0] : NULL);
+  double top_bytes = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    top_bytes += top[i]->count() * sizeof(Dtype);
+  }
+  double param_bytes = 0;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    param_bytes += blobs_[i]->count() * sizeof(Dtype);
+  }
+  Profiler::Get()->Record(layer_param_.name(), type(),
+      shape_blob ? shape_blob->shape_string() : string(), backward,
+      microseconds,
+      backward ? BackwardFlops(top, bottom) : ForwardFlops(bottom, top),
+      backward ? BackwardBytes(top, bottom) : ForwardBytes(bottom, top),
+      top_bytes, param_bytes, counters);
+}
+
 INSTANTIATE_CLASS(Layer);
 
 }  // namespace caffe
@@ -5,9 +5,34 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/memory_tracker.hpp"
 
 namespace caffe {
 
+namespace {
+
+// Copy the rows x spatial_dim matrix of image b in and out of the columns of a
+// matrix holding num images side by side.
+template <typename Dtype>
+void batch_rows_in(const Dtype* image, int rows, int spatial_dim, int b,
+    int num, Dtype* batch) {
+  for (int r = 0; r < rows; ++r) {
+    caffe_copy(spatial_dim, image + r * spatial_dim,
+        batch + (r * num + b) * spatial_dim);
+  }
+}
+
+template <typename Dtype>
+void batch_rows_out(const Dtype* batch, int rows, int spatial_dim, int b,
+    int num, Dtype* image) {
+  for (int r = 0; r < rows; ++r) {
+    caffe_copy(spatial_dim, batch + (r * num + b) * spatial_dim,
+        image + r * spatial_dim);
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -238,7 +263,13 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
-  col_buffer_.Reshape(col_buffer_shape_);
+  {
+    MemoryTracker::Scope memory_scope(this->layer_param_.name(),
+                                      MemoryTracker::COL_BUFFER);
+    col_buffer_.Reshape(col_buffer_shape_);
+  }
+  set_gemm_batch(gemm_batch_for_bytes(
+      this->layer_param_.convolution_param().gemm_batch_bytes()));
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -253,6 +284,31 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::gemm_batch_for_bytes(uint64_t bytes) const {
+  // Count both the columns and the outputs of each image.
+  const uint64_t image_bytes = sizeof(Dtype) * conv_out_spatial_dim_ *
+      static_cast<uint64_t>(kernel_dim_ * group_ + conv_out_channels_);
+  const uint64_t batch = std::min<uint64_t>(std::max(num_, 1),
+      bytes / std::max<uint64_t>(image_bytes, 1));
+  return std::max(static_cast<int>(batch), 1);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::set_gemm_batch(int gemm_batch) {
+  CHECK_GE(gemm_batch, 1);
+  gemm_batch_ = gemm_batch;
+  if (gemm_batch_ > 1) {
+    MemoryTracker::Scope memory_scope(this->layer_param_.name(),
+                                      MemoryTracker::COL_BUFFER);
+    vector<int> batch_shape(1, kernel_dim_ * group_);
+    batch_shape.push_back(gemm_batch_ * conv_out_spatial_dim_);
+    batch_col_buffer_.Reshape(batch_shape);
+    batch_shape[0] = conv_out_channels_;
+    batch_output_buffer_.Reshape(batch_shape);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
@@ -273,7 +329,13 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
-    const Dtype* bias) {
+    const Dtype* bias, bool channels_last) {
+  if (channels_last) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_spatial_dim_,
+        num_output_, 1, (Dtype)1., bias_multiplier_.cpu_data(), bias,
+        (Dtype)1., output);
+    return;
+  }
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
       out_spatial_dim_, 1, (Dtype)1., bias, bias_multiplier_.cpu_data(),
       (Dtype)1., output);
@@ -315,11 +377,111 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
-    const Dtype* input) {
+    const Dtype* input, bool channels_last) {
+  if (channels_last) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, out_spatial_dim_, num_output_, 1.,
+        input, bias_multiplier_.cpu_data(), 1., bias);
+    return;
+  }
   caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, out_spatial_dim_, 1.,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, int num, bool skip_im2col) {
+  CHECK_LE(num, gemm_batch_);
+  const int conv_in_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int conv_out_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const int batch_spatial_dim = num * conv_out_spatial_dim_;
+  Dtype* col_buff = batch_col_buffer_.mutable_cpu_data();
+  Dtype* output_buff = batch_output_buffer_.mutable_cpu_data();
+  if (!skip_im2col) {
+    for (int b = 0; b < num; ++b) {
+      const Dtype* image_col = input + b * conv_in_dim;
+      if (!is_1x1_) {
+        conv_im2col_cpu(image_col, col_buffer_.mutable_cpu_data());
+        image_col = col_buffer_.cpu_data();
+      }
+      batch_rows_in(image_col, kernel_dim_ * group_, conv_out_spatial_dim_,
+          b, num, col_buff);
+    }
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, batch_spatial_dim, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_buff + kernel_dim_ * batch_spatial_dim * g, (Dtype)0.,
+        output_buff + conv_out_channels_ / group_ * batch_spatial_dim * g);
+  }
+  for (int b = 0; b < num; ++b) {
+    batch_rows_out(output_buff, conv_out_channels_, conv_out_spatial_dim_, b,
+        num, output + b * conv_out_dim);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(const Dtype* output,
+    const Dtype* weights, Dtype* input, int num) {
+  CHECK_LE(num, gemm_batch_);
+  const int conv_in_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int conv_out_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const int batch_spatial_dim = num * conv_out_spatial_dim_;
+  Dtype* col_buff = batch_col_buffer_.mutable_cpu_data();
+  Dtype* output_buff = batch_output_buffer_.mutable_cpu_data();
+  for (int b = 0; b < num; ++b) {
+    batch_rows_in(output + b * conv_out_dim, conv_out_channels_,
+        conv_out_spatial_dim_, b, num, output_buff);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        batch_spatial_dim, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        output_buff + conv_out_channels_ / group_ * batch_spatial_dim * g,
+        (Dtype)0., col_buff + kernel_dim_ * batch_spatial_dim * g);
+  }
+  for (int b = 0; b < num; ++b) {
+    if (is_1x1_) {
+      batch_rows_out(col_buff, kernel_dim_ * group_, conv_out_spatial_dim_, b,
+          num, input + b * conv_in_dim);
+    } else {
+      batch_rows_out(col_buff, kernel_dim_ * group_, conv_out_spatial_dim_, b,
+          num, col_buffer_.mutable_cpu_data());
+      conv_col2im_cpu(col_buffer_.cpu_data(), input + b * conv_in_dim);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output, Dtype* weights, int num) {
+  CHECK_LE(num, gemm_batch_);
+  const int conv_in_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int conv_out_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const int batch_spatial_dim = num * conv_out_spatial_dim_;
+  Dtype* col_buff = batch_col_buffer_.mutable_cpu_data();
+  Dtype* output_buff = batch_output_buffer_.mutable_cpu_data();
+  for (int b = 0; b < num; ++b) {
+    const Dtype* image_col = input + b * conv_in_dim;
+    if (!is_1x1_) {
+      conv_im2col_cpu(image_col, col_buffer_.mutable_cpu_data());
+      image_col = col_buffer_.cpu_data();
+    }
+    batch_rows_in(image_col, kernel_dim_ * group_, conv_out_spatial_dim_, b,
+        num, col_buff);
+    batch_rows_in(output + b * conv_out_dim, conv_out_channels_,
+        conv_out_spatial_dim_, b, num, output_buff);
+  }
+  // The gradients of all images accumulate in one GEMM over their columns.
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, batch_spatial_dim,
+        (Dtype)1., output_buff + conv_out_channels_ / group_ *
+        batch_spatial_dim * g, col_buff + kernel_dim_ * batch_spatial_dim * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
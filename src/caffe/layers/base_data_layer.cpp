@@ -8,6 +8,8 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/memory_tracker.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -50,10 +52,14 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
+  MemoryTracker::Account* prefetch_account = MemoryTracker::Get()->account(
+      this->layer_param_.name(), MemoryTracker::PREFETCH);
   for (int i = 0; i < PREFETCH_COUNT; ++i) {
     prefetch_[i].data_.mutable_cpu_data();
+    prefetch_[i].data_.data()->set_account(prefetch_account);
     if (this->output_labels_) {
       prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i].label_.data()->set_account(prefetch_account);
     }
   }
 #ifndef CPU_ONLY
@@ -81,9 +87,13 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  Tracer::SetThreadName("Prefetch " + this->layer_param_.name());
+  MemoryTracker::Scope memory_scope(this->layer_param_.name(),
+                                    MemoryTracker::PREFETCH);
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      TraceSpan trace("Load batch", "data");
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
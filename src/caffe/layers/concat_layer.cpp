@@ -50,6 +50,18 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+    return;
+  }
+  // Inputs which Net made views into the output (see zero_copy_concat) no
+  // longer line up with their slice if the shapes changed: give them memory
+  // of their own, keeping the data, before anything is written to the top.
+  int offset = top[0]->data_offset();
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (bottom[i]->data() == top[0]->data() &&
+        (num_concats_ != 1 || bottom[i]->data_offset() != offset)) {
+      bottom[i]->Unshare(true);
+    }
+    offset += bottom[i]->count();
   }
 }
 
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <sstream>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -21,6 +25,239 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  channels_last_ = this->layer_param_.convolution_param().layout() ==
+      LayoutParameter_Layout_NHWC;
+  if (channels_last_) {
+    CHECK(this->is_1x1_ && this->group_ == 1 && this->channel_axis_ == 1)
+        << "NHWC is only supported for 1x1 convolutions with stride 1, no "
+        << "padding and a single group.";
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::Reshape(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  if (channels_last_) {
+    // A single GEMM over the whole batch, see forward_cpu_convolution.
+    direct_ = false;
+    return;
+  }
+  switch (conv_param.cpu_algorithm()) {
+  case ConvolutionParameter_CPUAlgorithm_HEURISTIC:
+    direct_ = depthwise();
+    break;
+  case ConvolutionParameter_CPUAlgorithm_GEMM:
+    direct_ = false;
+    break;
+  case ConvolutionParameter_CPUAlgorithm_DIRECT:
+    CHECK(depthwise()) << "The DIRECT algorithm requires a depthwise "
+        << "convolution, with group == channels and 2 spatial axes.";
+    direct_ = true;
+    break;
+  case ConvolutionParameter_CPUAlgorithm_AUTOTUNE:
+    // Time the algorithms only when running on the CPU, and only for shapes
+    // not seen before; the base Reshape has reset gemm_batch_ meanwhile.
+    if (Caffe::mode() == Caffe::CPU) {
+      if (bottom[0]->shape() != tuned_shape_) {
+        const ConvAlgorithmCache::Choice choice = Autotune(*bottom[0], *top[0]);
+        direct_ = choice.algorithm == ConvolutionParameter_CPUAlgorithm_DIRECT;
+        tuned_gemm_batch_ = choice.gemm_batch;
+        tuned_shape_ = bottom[0]->shape();
+      }
+      this->set_gemm_batch(tuned_gemm_batch_);
+    } else {
+      direct_ = false;
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unknown CPU convolution algorithm "
+        << conv_param.cpu_algorithm();
+  }
+}
+
+template <typename Dtype>
+ConvAlgorithmCache::Choice ConvolutionLayer<Dtype>::Autotune(
+    const Blob<Dtype>& bottom, const Blob<Dtype>& top) {
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  // Lower up to 64MB of images at once unless gemm_batch_bytes says otherwise.
+  const uint64_t batch_bytes = conv_param.has_gemm_batch_bytes() ?
+      conv_param.gemm_batch_bytes() : (64 << 20);
+  const bool backward = this->phase_ == TRAIN;
+  std::ostringstream key;
+  key << ConvAlgorithmCache::HostKey() << " "
+      << (sizeof(Dtype) == sizeof(float) ? "float" : "double") << " "
+      << (backward ? "train" : "test") << " " << bottom.shape_string()
+      << " output " << this->num_output_ << " group " << this->group_;
+  const Blob<int>* geometry[] = {&this->kernel_shape_, &this->pad_,
+                                 &this->stride_, &this->dilation_};
+  const char* names[] = {"kernel", "pad", "stride", "dilation"};
+  for (int g = 0; g < 4; ++g) {
+    key << " " << names[g] << " ";
+    for (int i = 0; i < this->num_spatial_axes_; ++i) {
+      key << (i ? "x" : "") << geometry[g]->cpu_data()[i];
+    }
+  }
+  key << " batch_bytes " << batch_bytes;
+  ConvAlgorithmCache* cache = ConvAlgorithmCache::Get();
+  ConvAlgorithmCache::Choice best;
+  if (cache->Lookup(key.str(), &best)) {
+    return best;
+  }
+
+  // The candidates: one image at a time, a batch of them, and the depthwise
+  // kernels where they apply.
+  vector<ConvAlgorithmCache::Choice> candidates(1);
+  candidates[0].algorithm = ConvolutionParameter_CPUAlgorithm_GEMM;
+  const int gemm_batch = this->gemm_batch_for_bytes(batch_bytes);
+  if (gemm_batch > 1) {
+    candidates.push_back(candidates[0]);
+    candidates.back().gemm_batch = gemm_batch;
+  }
+  if (depthwise()) {
+    candidates.push_back(candidates[0]);
+    candidates.back().algorithm = ConvolutionParameter_CPUAlgorithm_DIRECT;
+  }
+
+  // Run them on scratch blobs, so that the layer's own blobs and the weight
+  // gradient are left alone.
+  Blob<Dtype> data(bottom.shape()), output(top.shape());
+  Blob<Dtype> weight_diff(this->blobs_[0]->shape());
+  caffe_set(data.count(), Dtype(0.5), data.mutable_cpu_data());
+  caffe_set(output.count(), Dtype(0.5), output.mutable_cpu_diff());
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int kTimedRuns = 3;
+  CPUTimer timer;
+  for (int c = 0; c < candidates.size(); ++c) {
+    direct_ =
+        candidates[c].algorithm == ConvolutionParameter_CPUAlgorithm_DIRECT;
+    this->set_gemm_batch(candidates[c].gemm_batch);
+    float fastest = 0;
+    // The first run warms up the caches and buffers and is not counted.
+    for (int run = 0; run <= kTimedRuns; ++run) {
+      timer.Start();
+      forward_cpu_convolution(data.cpu_data(), weight,
+          output.mutable_cpu_data());
+      if (backward) {
+        backward_cpu_convolution(output.cpu_diff(), data.cpu_data(), weight,
+            weight_diff.mutable_cpu_diff(), data.mutable_cpu_diff());
+      }
+      timer.Stop();
+      if (run == 1 || (run > 1 && timer.MicroSeconds() < fastest)) {
+        fastest = timer.MicroSeconds();
+      }
+    }
+    candidates[c].microseconds = fastest;
+    if (c == 0 || fastest < best.microseconds) {
+      best = candidates[c];
+    }
+  }
+  LOG(INFO) << this->layer_param_.name() << ": using "
+      << ConvolutionParameter_CPUAlgorithm_Name(
+          static_cast<ConvolutionParameter_CPUAlgorithm>(best.algorithm))
+      << " with gemm_batch " << best.gemm_batch << " (" << best.microseconds
+      << " us of " << candidates.size() << " candidates) for "
+      << bottom.shape_string();
+  cache->Insert(key.str(), best);
+  return best;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_convolution(const Dtype* bottom_data,
+    const Dtype* weight, Dtype* top_data) {
+  if (channels_last_) {
+    // The pixels of the batch are the rows of a num_ * out_spatial_dim_ x
+    // channels_ matrix, to multiply by the transposed weights.
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
+        this->num_ * this->out_spatial_dim_, this->num_output_,
+        this->channels_, (Dtype)1., bottom_data, weight, (Dtype)0., top_data);
+    return;
+  }
+  if (direct_) {
+    for (int n = 0; n < this->num_; ++n) {
+      this->forward_cpu_depthwise(bottom_data + n * this->bottom_dim_,
+          weight, top_data + n * this->top_dim_);
+    }
+    return;
+  }
+  for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+    const int batch = std::min(this->gemm_batch_, this->num_ - n);
+    if (batch > 1) {
+      this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+          weight, top_data + n * this->top_dim_, batch);
+    } else {
+      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+          top_data + n * this->top_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_convolution(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* weight, Dtype* weight_diff,
+    Dtype* bottom_diff) {
+  if (channels_last_) {
+    const int pixels = this->num_ * this->out_spatial_dim_;
+    if (weight_diff) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, this->num_output_,
+          this->channels_, pixels, (Dtype)1., top_diff, bottom_data,
+          (Dtype)1., weight_diff);
+    }
+    if (bottom_diff) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, pixels,
+          this->channels_, this->num_output_, (Dtype)1., top_diff, weight,
+          (Dtype)0., bottom_diff);
+    }
+    return;
+  }
+  if (direct_) {
+    for (int n = 0; n < this->num_; ++n) {
+      if (weight_diff) {
+        this->weight_cpu_depthwise(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff);
+      }
+      if (bottom_diff) {
+        this->backward_cpu_depthwise(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_);
+      }
+    }
+    return;
+  }
+  if (!weight_diff && !bottom_diff) {
+    return;
+  }
+  for (int n = 0; n < this->num_; n += this->gemm_batch_) {
+    const int batch = std::min(this->gemm_batch_, this->num_ - n);
+    // gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (weight_diff) {
+      if (batch > 1) {
+        this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff, batch);
+      } else {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff);
+      }
+    }
+    // gradient w.r.t. bottom data, if necessary.
+    if (bottom_diff) {
+      if (batch > 1) {
+        this->backward_cpu_gemm_batch(top_diff + n * this->top_dim_,
+            weight, bottom_diff + n * this->bottom_dim_, batch);
+      } else {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_);
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -28,12 +265,12 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    forward_cpu_convolution(bottom_data, weight, top_data);
+    if (this->bias_term_) {
+      const Dtype* bias = this->blobs_[1]->cpu_data();
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias,
+            channels_last_);
       }
     }
   }
@@ -43,32 +280,20 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
       for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
-      }
-    }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
+        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_,
+            channels_last_);
       }
     }
+    backward_cpu_convolution(top_diff, bottom[i]->cpu_data(), weight,
+        this->param_propagate_down_[0] ?
+            this->blobs_[0]->mutable_cpu_diff() : NULL,
+        propagate_down[i] ? bottom[i]->mutable_cpu_diff() : NULL);
   }
 }
 
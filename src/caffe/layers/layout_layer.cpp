@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/layout_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  top[0]->ReshapeLike(*bottom[0]);
+  num_ = bottom[0]->num_axes() > 0 ? bottom[0]->shape(0) : 1;
+  channels_ = bottom[0]->num_axes() > 1 ? bottom[0]->shape(1) : 1;
+  spatial_dim_ = bottom[0]->count(std::min(2, bottom[0]->num_axes()));
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Transpose(const Dtype* in, int rows, int cols,
+    Dtype* out) {
+  // Go through blocks small enough for both their rows in and their columns
+  // out to stay in the cache.
+  const int kBlock = 16;
+  const int dim = rows * cols;
+  for (int n = 0; n < num_; ++n, in += dim, out += dim) {
+    for (int r0 = 0; r0 < rows; r0 += kBlock) {
+      const int r1 = std::min(r0 + kBlock, rows);
+      for (int c0 = 0; c0 < cols; c0 += kBlock) {
+        const int c1 = std::min(c0 + kBlock, cols);
+        for (int r = r0; r < r1; ++r) {
+          for (int c = c0; c < c1; ++c) {
+            out[c * rows + r] = in[r * cols + c];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  // The items are channels x spatial_dim matrices in NCHW, and their
+  // transposes in NHWC.
+  const bool to_nhwc = this->layer_param_.layout_param().layout() ==
+      LayoutParameter_Layout_NHWC;
+  Transpose(bottom[0]->cpu_data(), to_nhwc ? channels_ : spatial_dim_,
+      to_nhwc ? spatial_dim_ : channels_, top[0]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  const bool to_nhwc = this->layer_param_.layout_param().layout() ==
+      LayoutParameter_Layout_NHWC;
+  Transpose(top[0]->cpu_diff(), to_nhwc ? spatial_dim_ : channels_,
+      to_nhwc ? channels_ : spatial_dim_, bottom[0]->mutable_cpu_diff());
+}
+
+INSTANTIATE_CLASS(LayoutLayer);
+REGISTER_LAYER_CLASS(Layout);
+
+}  // namespace caffe
@@ -1,10 +1,228 @@
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/util/cpu_features.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+namespace {
+
+// sum[i] += sign * x[i], or sign * x[i]^2 with square set.
+template <typename Dtype>
+inline void accumulate(const int n, const Dtype* x, const Dtype sign,
+    const bool square, Dtype* sum) {
+  if (square) {
+    for (int i = 0; i < n; ++i) {
+      sum[i] += sign * x[i] * x[i];
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      sum[i] += sign * x[i];
+    }
+  }
+}
+
+// Sums x, or its squares, over the size x size windows centered on each
+// pixel of a height x width plane, clipped to the plane. A running sum of
+// the rows in the window slides down the plane, and each output row adds
+// shifted copies of it, so that all the loops run along the rows.
+// column_sum holds width values and row width + size - 1.
+template <typename Dtype>
+inline void window_sum(const Dtype* x, const bool square, const int height,
+    const int width, const int size, Dtype* column_sum, Dtype* row,
+    Dtype* sum) {
+  const int pad = (size - 1) / 2;
+  caffe_set(width, Dtype(0), column_sum);
+  caffe_set(width + size - 1, Dtype(0), row);
+  for (int h = 0; h < pad && h < height; ++h) {
+    accumulate(width, x + h * width, Dtype(1), square, column_sum);
+  }
+  for (int h = 0; h < height; ++h) {
+    // Bring column_sum to the rows [h - pad, h + pad].
+    const int head = h + pad;
+    const int tail = h - pad - 1;
+    if (head < height) {
+      accumulate(width, x + head * width, Dtype(1), square, column_sum);
+    }
+    if (tail >= 0) {
+      accumulate(width, x + tail * width, Dtype(-1), square, column_sum);
+    }
+    caffe_copy(width, column_sum, row + pad);
+    Dtype* sum_row = sum + h * width;
+    caffe_copy(width, row, sum_row);
+    for (int k = 1; k < size; ++k) {
+      const Dtype* shifted = row + k;
+      for (int w = 0; w < width; ++w) {
+        sum_row[w] += shifted[w];
+      }
+    }
+  }
+}
+
+// The CPU kernels, run on one image or plane at a time by cpu_dispatch_for.
+// Each slides its window along the channels or down the plane, adding what
+// enters it and subtracting what leaves it, in place of summing every
+// window from scratch.
+
+template <typename Dtype>
+struct CrossChannelForwardImage {
+  const Dtype* bottom_data;
+  int channels;
+  int spatial_dim;
+  int pre_pad;
+  Dtype k;
+  Dtype alpha_over_size;
+  Dtype beta;
+  Dtype* window;  // the sum of squares over the channels in the window
+  Dtype* scale_data;
+  Dtype* top_data;
+  void operator()(const int n) const {
+    const int image_offset = n * channels * spatial_dim;
+    caffe_set(spatial_dim, Dtype(0), window);
+    for (int c = 0; c < pre_pad && c < channels; ++c) {
+      accumulate(spatial_dim, bottom_data + image_offset + c * spatial_dim,
+          Dtype(1), true, window);
+    }
+    for (int c = 0; c < channels; ++c) {
+      // add head, compute the scale, then subtract tail
+      const int head = c + pre_pad;
+      if (head < channels) {
+        accumulate(spatial_dim,
+            bottom_data + image_offset + head * spatial_dim, Dtype(1), true,
+            window);
+      }
+      const int offset = image_offset + c * spatial_dim;
+      Dtype* scale = scale_data + offset;
+      for (int i = 0; i < spatial_dim; ++i) {
+        scale[i] = k + alpha_over_size * window[i];
+      }
+      const int tail = c - pre_pad;
+      if (tail >= 0) {
+        accumulate(spatial_dim,
+            bottom_data + image_offset + tail * spatial_dim, Dtype(-1), true,
+            window);
+      }
+      // compute output while the channel is in cache
+      caffe_powx<Dtype>(spatial_dim, scale, -beta, top_data + offset);
+      caffe_mul<Dtype>(spatial_dim, top_data + offset, bottom_data + offset,
+          top_data + offset);
+    }
+  }
+};
+
+template <typename Dtype>
+struct CrossChannelBackwardImage {
+  const Dtype* top_diff;
+  const Dtype* top_data;
+  const Dtype* bottom_data;
+  const Dtype* scale_data;
+  int channels;
+  int spatial_dim;
+  int pre_pad;
+  Dtype beta;
+  Dtype cache_ratio_value;
+  Dtype* ratio;  // diff_i * y_i / s_i for the channels of the image
+  Dtype* accum_ratio;  // its sum over the channels in the window
+  Dtype* bottom_diff;
+  void operator()(const int n) const {
+    const int image_offset = n * channels * spatial_dim;
+    for (int i = 0; i < channels * spatial_dim; ++i) {
+      ratio[i] = top_diff[image_offset + i] * top_data[image_offset + i] /
+          scale_data[image_offset + i];
+    }
+    caffe_set(spatial_dim, Dtype(0), accum_ratio);
+    for (int c = 0; c < pre_pad && c < channels; ++c) {
+      accumulate(spatial_dim, ratio + c * spatial_dim, Dtype(1), false,
+          accum_ratio);
+    }
+    for (int c = 0; c < channels; ++c) {
+      const int head = c + pre_pad;
+      if (head < channels) {
+        accumulate(spatial_dim, ratio + head * spatial_dim, Dtype(1), false,
+            accum_ratio);
+      }
+      const int offset = image_offset + c * spatial_dim;
+      caffe_powx<Dtype>(spatial_dim, scale_data + offset, -beta,
+          bottom_diff + offset);
+      for (int i = 0; i < spatial_dim; ++i) {
+        bottom_diff[offset + i] = top_diff[offset + i] * bottom_diff[offset + i]
+            - cache_ratio_value * bottom_data[offset + i] * accum_ratio[i];
+      }
+      const int tail = c - pre_pad;
+      if (tail >= 0) {
+        accumulate(spatial_dim, ratio + tail * spatial_dim, Dtype(-1), false,
+            accum_ratio);
+      }
+    }
+  }
+};
+
+template <typename Dtype>
+struct WithinChannelForwardPlane {
+  const Dtype* bottom_data;
+  int height;
+  int width;
+  int size;
+  Dtype alpha_over_size;
+  Dtype beta;
+  Dtype* column_sum;
+  Dtype* row;
+  Dtype* scale_data;
+  Dtype* top_data;
+  void operator()(const int p) const {
+    const int spatial_dim = height * width;
+    const int offset = p * spatial_dim;
+    Dtype* scale = scale_data + offset;
+    window_sum(bottom_data + offset, true, height, width, size, column_sum,
+        row, scale);
+    for (int i = 0; i < spatial_dim; ++i) {
+      scale[i] = 1 + alpha_over_size * scale[i];
+    }
+    caffe_powx<Dtype>(spatial_dim, scale, -beta, top_data + offset);
+    caffe_mul<Dtype>(spatial_dim, top_data + offset, bottom_data + offset,
+        top_data + offset);
+  }
+};
+
+template <typename Dtype>
+struct WithinChannelBackwardPlane {
+  const Dtype* top_diff;
+  const Dtype* top_data;
+  const Dtype* bottom_data;
+  const Dtype* scale_data;
+  int height;
+  int width;
+  int size;
+  Dtype beta;
+  Dtype cache_ratio_value;
+  Dtype* column_sum;
+  Dtype* row;
+  Dtype* ratio;
+  Dtype* accum_ratio;
+  Dtype* bottom_diff;
+  void operator()(const int p) const {
+    const int spatial_dim = height * width;
+    const int offset = p * spatial_dim;
+    for (int i = 0; i < spatial_dim; ++i) {
+      ratio[i] = top_diff[offset + i] * top_data[offset + i] /
+          scale_data[offset + i];
+    }
+    // The windows are symmetric, so each input gathers the ratios over its
+    // own window.
+    window_sum(ratio, false, height, width, size, column_sum, row,
+        accum_ratio);
+    caffe_powx<Dtype>(spatial_dim, scale_data + offset, -beta,
+        bottom_diff + offset);
+    for (int i = 0; i < spatial_dim; ++i) {
+      bottom_diff[offset + i] = top_diff[offset + i] * bottom_diff[offset + i]
+          - cache_ratio_value * bottom_data[offset + i] * accum_ratio[i];
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -80,6 +298,7 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     scale_.Reshape(num_, channels_, height_, width_);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
+    scale_.Reshape(num_, channels_, height_, width_);
     split_layer_->Reshape(bottom, split_top_vec_);
     square_layer_->Reshape(square_bottom_vec_, square_top_vec_);
     pool_layer_->Reshape(square_top_vec_, pool_top_vec_);
@@ -97,7 +316,7 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -107,48 +326,25 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
-    }
-  }
+  Blob<Dtype> window(1, 1, height_, width_);
+  const CrossChannelForwardImage<Dtype> forward = {bottom[0]->cpu_data(),
+      channels_, height_ * width_, pre_pad_, k_, alpha_ / size_, beta_,
+      window.mutable_cpu_data(), scale_.mutable_cpu_data(),
+      top[0]->mutable_cpu_data()};
+  cpu_dispatch_for(num_, forward);
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  Blob<Dtype> column_sum(1, 1, 1, width_);
+  Blob<Dtype> row(1, 1, 1, width_ + size_ - 1);
+  // The windows average over size * size values, counting the padding.
+  const WithinChannelForwardPlane<Dtype> forward = {bottom[0]->cpu_data(),
+      height_, width_, size_, alpha_ / (size_ * size_), beta_,
+      column_sum.mutable_cpu_data(), row.mutable_cpu_data(),
+      scale_.mutable_cpu_data(), top[0]->mutable_cpu_data()};
+  cpu_dispatch_for(num_ * channels_, forward);
 }
 
 template <typename Dtype>
@@ -169,7 +365,7 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -180,55 +376,32 @@ template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelBackward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* scale_data = scale_.cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
+  Blob<Dtype> ratio(1, channels_, height_, width_);
   Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  const CrossChannelBackwardImage<Dtype> backward = {top[0]->cpu_diff(),
+      top[0]->cpu_data(), bottom[0]->cpu_data(), scale_.cpu_data(),
+      channels_, height_ * width_, pre_pad_, beta_,
+      Dtype(2. * alpha_ * beta_ / size_), ratio.mutable_cpu_data(),
+      accum_ratio.mutable_cpu_data(), bottom[0]->mutable_cpu_diff()};
+  cpu_dispatch_for(num_, backward);
+}
 
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
-    }
-    for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
-    }
-  }
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  Blob<Dtype> column_sum(1, 1, 1, width_);
+  Blob<Dtype> row(1, 1, 1, width_ + size_ - 1);
+  Blob<Dtype> ratio(1, 1, height_, width_);
+  Blob<Dtype> accum_ratio(1, 1, height_, width_);
+  const WithinChannelBackwardPlane<Dtype> backward = {top[0]->cpu_diff(),
+      top[0]->cpu_data(), bottom[0]->cpu_data(), scale_.cpu_data(), height_,
+      width_, size_, beta_, Dtype(2. * alpha_ * beta_ / (size_ * size_)),
+      column_sum.mutable_cpu_data(), row.mutable_cpu_data(),
+      ratio.mutable_cpu_data(), accum_ratio.mutable_cpu_data(),
+      bottom[0]->mutable_cpu_diff()};
+  cpu_dispatch_for(num_ * channels_, backward);
 }
 
 template <typename Dtype>
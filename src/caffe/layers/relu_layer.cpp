@@ -2,9 +2,33 @@
 #include <vector>
 
 #include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/cpu_features.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+struct ReLUForward {
+  const Dtype* bottom_data;
+  Dtype negative_slope;
+  Dtype* top_data;
+  void operator()(const int i) const {
+    top_data[i] = std::max(bottom_data[i], Dtype(0))
+        + negative_slope * std::min(bottom_data[i], Dtype(0));
+  }
+};
+
+template <typename Dtype>
+struct ReLUBackward {
+  const Dtype* top_diff;
+  const Dtype* bottom_data;
+  Dtype negative_slope;
+  Dtype* bottom_diff;
+  void operator()(const int i) const {
+    bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+        + negative_slope * (bottom_data[i] <= 0));
+  }
+};
+
 template <typename Dtype>
 void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -12,10 +36,8 @@ void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + negative_slope * std::min(bottom_data[i], Dtype(0));
-  }
+  const ReLUForward<Dtype> forward = {bottom_data, negative_slope, top_data};
+  cpu_dispatch_for(count, forward);
 }
 
 template <typename Dtype>
@@ -28,10 +50,9 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
     Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + negative_slope * (bottom_data[i] <= 0));
-    }
+    const ReLUBackward<Dtype> backward = {top_diff, bottom_data,
+        negative_slope, bottom_diff};
+    cpu_dispatch_for(count, backward);
   }
 }
 
@@ -69,6 +69,18 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+    return;
+  }
+  // Outputs which Net made views into the input (see zero_copy_concat) no
+  // longer line up with their slice if the shapes changed: give them memory
+  // of their own.
+  int offset = bottom[0]->data_offset();
+  for (int i = 0; i < top.size(); ++i) {
+    if (top[i]->data() == bottom[0]->data() &&
+        (num_slices_ != 1 || top[i]->data_offset() != offset)) {
+      top[i]->Unshare(false);
+    }
+    offset += top[i]->count();
   }
 }
 
@@ -37,6 +37,11 @@ void SliceLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const int top_slice_axis = top[i]->shape(slice_axis_);
     const int top_slice_size = top_slice_axis * slice_size_;
     const int nthreads = top_slice_size * num_slices_;
+    // Views set up by zero_copy_concat need no copy.
+    if (top_data == bottom_data + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
         <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
         nthreads, bottom_data, kForward, num_slices_, slice_size_,
@@ -58,6 +63,10 @@ void SliceLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const int top_slice_axis = top[i]->shape(slice_axis_);
     const int top_slice_size = top_slice_axis * slice_size_;
     const int nthreads = top_slice_size * num_slices_;
+    if (top_diff == bottom_diff + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
         <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
         nthreads, top_diff, kForward, num_slices_, slice_size_,
@@ -7,6 +7,8 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/pooling.hpp"
 
 namespace caffe {
 
@@ -159,12 +161,41 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   bottom_w_ = bottom[0]->width();
   reshaped_first_time_ = true;
   SPPParameter spp_param = this->layer_param_.spp_param();
+  // The windows of each level, which the CPU pools with in one pass.
+  level_params_.clear();
+  pooled_heights_.clear();
+  pooled_widths_.clear();
+  for (int i = 0; i < pyramid_height_; i++) {
+    const PoolingParameter level_param =
+        GetPoolingParam(i, bottom_h_, bottom_w_, spp_param).pooling_param();
+    const int pad_h = level_param.pad_h();
+    const int pad_w = level_param.pad_w();
+    int pooled_height = static_cast<int>(ceil(static_cast<float>(
+        bottom_h_ + 2 * pad_h - level_param.kernel_h()) /
+        level_param.stride_h())) + 1;
+    int pooled_width = static_cast<int>(ceil(static_cast<float>(
+        bottom_w_ + 2 * pad_w - level_param.kernel_w()) /
+        level_param.stride_w())) + 1;
+    // As in PoolingLayer, the last window starts inside the image.
+    if (pad_h || pad_w) {
+      if ((pooled_height - 1) * level_param.stride_h() >= bottom_h_ + pad_h) {
+        --pooled_height;
+      }
+      if ((pooled_width - 1) * level_param.stride_w() >= bottom_w_ + pad_w) {
+        --pooled_width;
+      }
+    }
+    level_params_.push_back(level_param);
+    pooled_heights_.push_back(pooled_height);
+    pooled_widths_.push_back(pooled_width);
+  }
   if (pyramid_height_ == 1) {
     LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
         spp_param);
     pooling_layers_[0].reset(new PoolingLayer<Dtype>(pooling_param));
     pooling_layers_[0]->SetUp(bottom, top);
     pooling_layers_[0]->Reshape(bottom, top);
+    max_idx_.Reshape(top[0]->shape());
     return;
   }
   split_layer_->Reshape(bottom, split_top_vec_);
@@ -182,11 +213,95 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
         *pooling_top_vecs_[i], *flatten_top_vecs_[i]);
   }
   concat_layer_->Reshape(concat_bottom_vec_, top);
+  max_idx_.Reshape(top[0]->shape());
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Pool_cpu(const Dtype* bottom_data, Dtype* top_data,
+    int* mask) {
+  const int bottom_dim = channels_ * bottom_h_ * bottom_w_;
+  const int top_dim = max_idx_.count(1);
+  for (int n = 0; n < num_; ++n) {
+    // Each level writes its flattened output straight into its part of top.
+    int offset = n * top_dim;
+    for (int i = 0; i < pyramid_height_; i++) {
+      const PoolingParameter& level_param = level_params_[i];
+      switch (level_param.pool()) {
+      case PoolingParameter_PoolMethod_MAX:
+        max_pool_cpu(bottom_data + n * bottom_dim, channels_, bottom_h_,
+            bottom_w_, level_param.kernel_h(), level_param.kernel_w(),
+            level_param.pad_h(), level_param.pad_w(), level_param.stride_h(),
+            level_param.stride_w(), pooled_heights_[i], pooled_widths_[i],
+            top_data + offset, mask ? mask + offset : NULL);
+        break;
+      case PoolingParameter_PoolMethod_AVE:
+        ave_pool_cpu(bottom_data + n * bottom_dim, channels_, bottom_h_,
+            bottom_w_, level_param.kernel_h(), level_param.kernel_w(),
+            level_param.pad_h(), level_param.pad_w(), level_param.stride_h(),
+            level_param.stride_w(), pooled_heights_[i], pooled_widths_[i],
+            top_data + offset);
+        break;
+      case PoolingParameter_PoolMethod_STOCHASTIC:
+        NOT_IMPLEMENTED;
+        break;
+      default:
+        LOG(FATAL) << "Unknown pooling method.";
+      }
+      offset += channels_ * pooled_heights_[i] * pooled_widths_[i];
+    }
+  }
 }
 
 template <typename Dtype>
 void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  // Only training keeps the argmax for Backward.
+  Pool_cpu(bottom[0]->cpu_data(), top[0]->mutable_cpu_data(),
+      this->phase_ == TRAIN ? max_idx_.mutable_cpu_data() : NULL);
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const bool max_pooling = level_params_[0].pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  if (max_pooling && this->phase_ != TRAIN) {
+    // Forward skipped the argmax outside training; find it again.
+    Blob<Dtype> pooled(top[0]->shape());
+    Pool_cpu(bottom[0]->cpu_data(), pooled.mutable_cpu_data(),
+        max_idx_.mutable_cpu_data());
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const int* mask = max_pooling ? max_idx_.cpu_data() : NULL;
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const int top_dim = top[0]->count(1);
+  for (int n = 0; n < num_; ++n) {
+    int offset = n * top_dim;
+    for (int i = 0; i < pyramid_height_; i++) {
+      const PoolingParameter& level_param = level_params_[i];
+      if (max_pooling) {
+        max_pool_backward_cpu(top_diff + offset, mask + offset, channels_,
+            bottom_h_, bottom_w_, pooled_heights_[i], pooled_widths_[i],
+            bottom_diff + bottom[0]->offset(n));
+      } else {
+        ave_pool_backward_cpu(top_diff + offset, channels_, bottom_h_,
+            bottom_w_, level_param.kernel_h(), level_param.kernel_w(),
+            level_param.pad_h(), level_param.pad_w(), level_param.stride_h(),
+            level_param.stride_w(), pooled_heights_[i], pooled_widths_[i],
+            bottom_diff + bottom[0]->offset(n));
+      }
+      offset += channels_ * pooled_heights_[i] * pooled_widths_[i];
+    }
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
   if (pyramid_height_ == 1) {
     pooling_layers_[0]->Forward(bottom, top);
     return;
@@ -202,7 +317,7 @@ void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+void SPPLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) {
     return;
@@ -1,4 +1,8 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
+#include <cmath>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -13,8 +17,11 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_layouts.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/memory_tracker.hpp"
+#include "caffe/util/proto_stream.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -58,9 +65,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
-  // Create a copy of filtered_param with splits added where necessary.
+  // Switch runs of layers to NHWC if asked to.
+  NetParameter layout_param;
+  InsertLayouts(filtered_param, &layout_param);
+  // Create a copy of layout_param with splits added where necessary.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  InsertSplits(layout_param, &param);
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -133,7 +143,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
         AppendTop(param, layer_id, num_top, NULL, NULL);
       }
     }
-    // After this layer is connected, set it up.
+    // After this layer is connected, set it up, charging the memory it
+    // creates to the layer and its params to their own account.
+    MemoryTracker::Scope memory_scope(layer_names_[layer_id],
+                                      MemoryTracker::DATA);
     if (share_from_root) {
       // Set up size of top blobs using root_net_
       const vector<Blob<Dtype>*>& base_top = root_net_->top_vecs_[layer_id];
@@ -146,6 +159,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      MemoryTracker::Account* params_account = MemoryTracker::Get()->account(
+          layer_names_[layer_id], MemoryTracker::PARAMS);
+      for (int i = 0; i < layers_[layer_id]->blobs().size(); ++i) {
+        layers_[layer_id]->blobs()[i]->data()->set_account(params_account);
+        layers_[layer_id]->blobs()[i]->diff()->set_account(params_account);
+      }
     }
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
@@ -279,7 +298,40 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  zero_copy_concat_ = param.zero_copy_concat();
+  if (zero_copy_concat_) {
+    ShareConcatMemory();
+  }
+  if (param.recompute() && phase_ == TRAIN) {
+    InitRecompute(param);
+  }
+  reuse_buffers_ = param.reuse_buffers();
+  memory_reuse_planned_ = false;
+  if (param.layer_threads() > 0) {
+    if (segment_start_.empty()) {
+      scheduler_.reset(new TaskScheduler(param.layer_threads()));
+      ScheduleLayers();
+    } else {
+      LOG(WARNING) << "Layers are run one by one in recompute mode.";
+    }
+  }
   debug_info_ = param.debug_info();
+  plan_cache_bytes_ = 0;
+  if (param.plan_cache_bytes() > 0) {
+    if (phase_ == TEST) {
+      plan_cache_bytes_ = param.plan_cache_bytes();
+      // The plans run their layers one by one: only the current plan of this
+      // net is scheduled.
+      plan_param_.CopyFrom(in_param);
+      plan_param_.clear_plan_cache_bytes();
+      plan_param_.clear_layer_threads();
+      for (int i = 0; i < net_input_blobs_.size(); ++i) {
+        plan_shapes_.push_back(net_input_blobs_[i]->shape());
+      }
+    } else {
+      LOG(WARNING) << "Plans are only cached when testing.";
+    }
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -545,11 +597,34 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
   Dtype loss = 0;
+  if (plan_cache_bytes_ > 0 && start == 0) { SwitchPlan(); }
+  if (scheduler_ && Caffe::mode() == Caffe::CPU && start == 0 &&
+      end == layers_.size() - 1) {
+    scheduler_->Run(forward_successors_, layer_on_caller_,
+        boost::bind(&Net<Dtype>::ForwardLayer, this, _1));
+    for (int i = start; i <= end; ++i) {
+      loss += layer_losses_[i];
+      if (debug_info_) { ForwardDebugInfo(i); }
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
+    const int segment_id = layer_segment_.empty() ? -1 : layer_segment_[i];
+    if (segment_id >= 0 && segment_dropped_[segment_id]) {
+      if (i == segment_start_[segment_id]) {
+        segment_dropped_[segment_id] = false;
+      } else {
+        RecomputeSegment(segment_id);
+      }
+    }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
+    if (segment_id >= 0 && i == segment_end_[segment_id] &&
+        start <= segment_start_[segment_id]) {
+      DropSegment(segment_id);
+    }
   }
   return loss;
 }
@@ -590,8 +665,20 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (scheduler_ && Caffe::mode() == Caffe::CPU &&
+      start == layers_.size() - 1 && end == 0) {
+    scheduler_->Run(backward_successors_, layer_on_caller_,
+        boost::bind(&Net<Dtype>::BackwardLayer, this, _1));
+    for (int i = start; i >= end; --i) {
+      if (layer_need_backward_[i] && debug_info_) { BackwardDebugInfo(i); }
+    }
+    return;
+  }
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      if (!layer_segment_.empty() && segment_dropped_[layer_segment_[i]]) {
+        RecomputeSegment(layer_segment_[i]);
+      }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
@@ -599,6 +686,474 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ShareConcatMemory() {
+  const int num_layers = layers_.size();
+  // For each blob: the first and last layers using it, the number of layers
+  // reading it other than in place, whether a layer runs in place on it,
+  // whether its memory may be replaced from outside the net (tops of data
+  // layers, see set_cpu_data, and net inputs), and the number of blobs using
+  // its data and diff memory.
+  vector<int> first_use(blobs_.size(), num_layers);
+  vector<int> last_use(blobs_.size(), -1);
+  vector<int> num_readers(blobs_.size(), 0);
+  vector<bool> in_place(blobs_.size(), false);
+  vector<bool> external(blobs_.size(), false);
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      first_use[blob_id] = std::min(first_use[blob_id], i);
+      last_use[blob_id] = i;
+      if (std::find(top_id_vecs_[i].begin(), top_id_vecs_[i].end(), blob_id)
+          == top_id_vecs_[i].end()) {
+        ++num_readers[blob_id];
+      } else {
+        in_place[blob_id] = true;
+      }
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      first_use[blob_id] = std::min(first_use[blob_id], i);
+      last_use[blob_id] = i;
+      if (bottom_vecs_[i].empty()) { external[blob_id] = true; }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    external[net_input_blob_indices_[i]] = true;
+  }
+  map<const SyncedMemory*, int> num_users;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    ++num_users[blobs_[blob_id]->data().get()];
+    ++num_users[blobs_[blob_id]->diff().get()];
+  }
+  // Outer Concat layers are handled first, so that the inputs of a Concat
+  // feeding another one become views into the final output.
+  int num_shared = 0;
+  for (int k = 0; k < 2 * num_layers; ++k) {
+    const bool concat = k < num_layers;
+    const int i = concat ? num_layers - 1 - k : k - num_layers;
+    const string type = layers_[i]->type();
+    if (type != (concat ? "Concat" : "Slice")) { continue; }
+    const vector<Blob<Dtype>*>& parts = concat ? bottom_vecs_[i] : top_vecs_[i];
+    const vector<int>& part_ids = concat ? bottom_id_vecs_[i] : top_id_vecs_[i];
+    Blob<Dtype>* whole = concat ? top_vecs_[i][0] : bottom_vecs_[i][0];
+    const int whole_id = concat ? top_id_vecs_[i][0] : bottom_id_vecs_[i][0];
+    if (parts.size() < 2) { continue; }
+    const LayerParameter& layer_param = layers_[i]->layer_param();
+    int axis;
+    if (concat) {
+      const ConcatParameter& concat_param = layer_param.concat_param();
+      axis = concat_param.has_concat_dim() ? concat_param.concat_dim() :
+          whole->CanonicalAxisIndex(concat_param.axis());
+    } else {
+      const SliceParameter& slice_param = layer_param.slice_param();
+      axis = slice_param.has_slice_dim() ? slice_param.slice_dim() :
+          whole->CanonicalAxisIndex(slice_param.axis());
+    }
+    // The parts must be contiguous in the whole blob, and only be written
+    // while the whole is not in use: the parts of a Concat are used by it
+    // last, the whole of a Slice too, and neither the whole of a Concat nor
+    // the parts of a Slice are modified in place. The parts must hold memory
+    // of their own, or already be views into the whole.
+    bool can_share = whole->count(0, axis) == 1 &&
+        blob_loss_weights_[whole_id] == Dtype(0);
+    if (concat) {
+      can_share = can_share && !in_place[whole_id];
+    } else {
+      can_share = can_share && num_readers[whole_id] == 1 &&
+          last_use[whole_id] == i;
+    }
+    set<int> distinct_ids(part_ids.begin(), part_ids.end());
+    can_share = can_share && distinct_ids.size() == part_ids.size();
+    for (int j = 0; j < parts.size() && can_share; ++j) {
+      const int blob_id = part_ids[j];
+      const bool used_by_layer = concat ?
+          num_readers[blob_id] == 1 && last_use[blob_id] == i :
+          first_use[blob_id] == i && !in_place[blob_id];
+      const bool own_memory = !external[blob_id] &&
+          (num_users[parts[j]->data().get()] == 1 ||
+           parts[j]->data() == whole->data()) &&
+          (num_users[parts[j]->diff().get()] == 1 ||
+           parts[j]->diff() == whole->diff());
+      can_share = used_by_layer && own_memory &&
+          blob_loss_weights_[blob_id] == Dtype(0);
+    }
+    if (!can_share) { continue; }
+    int offset = 0;
+    for (int j = 0; j < parts.size(); ++j) {
+      parts[j]->ShareData(*whole, offset);
+      parts[j]->ShareDiff(*whole, offset);
+      offset += parts[j]->count();
+    }
+    ++num_shared;
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Sharing memory for " << num_shared << " Concat and Slice layers.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitRecompute(const NetParameter& param) {
+  const int num_layers = layers_.size();
+  // The layers reading and writing each blob.
+  vector<int> first_writer(blobs_.size(), num_layers);
+  vector<int> last_writer(blobs_.size(), -1);
+  vector<vector<int> > blob_layers(blobs_.size());
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      first_writer[blob_id] = std::min(first_writer[blob_id], i);
+      last_writer[blob_id] = i;
+      blob_layers[blob_id].push_back(i);
+    }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      blob_layers[bottom_id_vecs_[i][j]].push_back(i);
+    }
+  }
+  // A segment may end after layer i unless a later layer works in place on a
+  // blob written up to i: recomputing either side would corrupt the other.
+  vector<bool> can_end(num_layers, false);
+  int max_last_writer = -1;
+  for (int i = 0; i < num_layers; ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      max_last_writer = std::max(max_last_writer,
+          last_writer[top_id_vecs_[i][j]]);
+    }
+    can_end[i] = max_last_writer <= i;
+  }
+  vector<bool> is_end(num_layers, false);
+  is_end[num_layers - 1] = true;
+  if (param.recompute_checkpoint_size() > 0) {
+    for (int c = 0; c < param.recompute_checkpoint_size(); ++c) {
+      const string& name = param.recompute_checkpoint(c);
+      CHECK(layer_names_index_.count(name))
+          << "Unknown recompute checkpoint layer " << name;
+      const int layer_id = layer_names_index_[name];
+      CHECK(can_end[layer_id]) << "Cannot end a recompute segment at layer "
+          << name << ": a later layer works in place on its output.";
+      is_end[layer_id] = true;
+    }
+  } else {
+    const int length = std::max(1,
+        static_cast<int>(std::sqrt(static_cast<float>(num_layers)) + 0.5f));
+    int segment_length = 0;
+    for (int i = 0; i < num_layers; ++i) {
+      if (++segment_length >= length && can_end[i]) {
+        is_end[i] = true;
+        segment_length = 0;
+      }
+    }
+  }
+  layer_segment_.resize(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    if (i == 0 || is_end[i - 1]) {
+      segment_start_.push_back(i);
+    }
+    layer_segment_[i] = segment_start_.size() - 1;
+    if (is_end[i]) {
+      segment_end_.push_back(i);
+    }
+  }
+  const int num_segments = segment_start_.size();
+  segment_drop_blob_ids_.resize(num_segments);
+  segment_dropped_.resize(num_segments, false);
+  // Drop the blobs only read and written inside segments that can be rerun.
+  // The last segment is backpropagated right after its forward pass.
+  vector<bool> is_output(blobs_.size(), false);
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    is_output[net_output_blob_indices_[i]] = true;
+  }
+  vector<bool> can_recompute(num_segments, true);
+  can_recompute[num_segments - 1] = false;
+  for (int i = 0; i < num_layers; ++i) {
+    if (bottom_vecs_[i].empty() || !layers_[i]->AllowRecompute()) {
+      can_recompute[layer_segment_[i]] = false;
+    }
+  }
+  int num_recomputed = 0;
+  size_t dropped_count = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (last_writer[blob_id] < 0 || is_output[blob_id]) { continue; }
+    const int segment_id = layer_segment_[first_writer[blob_id]];
+    if (!can_recompute[segment_id]) { continue; }
+    bool inside = true;
+    for (int j = 0; j < blob_layers[blob_id].size(); ++j) {
+      inside &= layer_segment_[blob_layers[blob_id][j]] == segment_id;
+    }
+    if (inside) {
+      num_recomputed += segment_drop_blob_ids_[segment_id].empty();
+      segment_drop_blob_ids_[segment_id].push_back(blob_id);
+      dropped_count += blobs_[blob_id]->count();
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Recomputing " << num_recomputed << " of " << num_segments
+      << " segments in backward; memory freed for data: "
+      << dropped_count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+void Net<Dtype>::DropSegment(const int segment_id) {
+  const vector<int>& blob_ids = segment_drop_blob_ids_[segment_id];
+  if (blob_ids.empty()) { return; }
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    blobs_[blob_ids[i]]->ReleaseData();
+  }
+  segment_dropped_[segment_id] = true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(const int segment_id) {
+  for (int i = segment_start_[segment_id]; i <= segment_end_[segment_id];
+       ++i) {
+    layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+  }
+  segment_dropped_[segment_id] = false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemoryReuse() {
+  // Planned after a forward pass, so that blobs sharing memory (e.g. split
+  // and flatten tops) are known, as groups keyed by their SyncedMemory.
+  const int num_layers = layers_.size();
+  vector<bool> can_reuse(blobs_.size(), true);
+  vector<int> first_use(blobs_.size(), num_layers);
+  vector<int> diff_written(blobs_.size(), -1);
+  vector<int> diff_read(blobs_.size(), num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    // Tops of layers without bottoms (data, input, parameter layers) may be
+    // kept across iterations.
+    const bool allow_reuse = layers_[i]->AllowMemoryReuse() &&
+        !bottom_vecs_[i].empty();
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      first_use[blob_id] = std::min(first_use[blob_id], i);
+      can_reuse[blob_id] = can_reuse[blob_id] && allow_reuse;
+      if (layer_need_backward_[i] && bottom_need_backward_[i][j]) {
+        diff_written[blob_id] = i;
+      }
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      first_use[blob_id] = std::min(first_use[blob_id], i);
+      can_reuse[blob_id] = can_reuse[blob_id] && allow_reuse;
+      diff_read[blob_id] = std::min(diff_read[blob_id], i);
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    can_reuse[net_input_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    can_reuse[net_output_blob_indices_[i]] = false;
+  }
+  set<SyncedMemory*> param_memory;
+  for (int i = 0; i < params_.size(); ++i) {
+    param_memory.insert(params_[i]->data().get());
+    param_memory.insert(params_[i]->diff().get());
+  }
+  // A diff is live in Backward from the first layer writing it (highest
+  // index) through the layer producing the blob (lowest index). A blob's data
+  // is dead once the first layer using it has been backpropagated.
+  map<SyncedMemory*, int> diff_group;
+  vector<vector<int> > diff_blob_ids;
+  vector<int> diff_start, diff_end;
+  vector<bool> diff_can_reuse;
+  map<SyncedMemory*, int> data_group;
+  vector<shared_ptr<SyncedMemory> > data_memory;
+  vector<int> data_end;
+  vector<bool> data_can_reuse;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const bool reuse = can_reuse[blob_id] &&
+        blob_loss_weights_[blob_id] == Dtype(0);
+    shared_ptr<SyncedMemory> diff = blobs_[blob_id]->diff();
+    if (!diff_group.count(diff.get())) {
+      diff_group[diff.get()] = diff_blob_ids.size();
+      diff_blob_ids.push_back(vector<int>());
+      diff_start.push_back(-1);
+      diff_end.push_back(num_layers);
+      diff_can_reuse.push_back(!param_memory.count(diff.get()));
+    }
+    const int g = diff_group[diff.get()];
+    diff_blob_ids[g].push_back(blob_id);
+    diff_start[g] = std::max(diff_start[g], diff_written[blob_id]);
+    diff_end[g] = std::min(diff_end[g], diff_read[blob_id]);
+    diff_can_reuse[g] = diff_can_reuse[g] && reuse &&
+        diff_written[blob_id] >= 0;
+    shared_ptr<SyncedMemory> data = blobs_[blob_id]->data();
+    if (!data_group.count(data.get())) {
+      data_group[data.get()] = data_memory.size();
+      data_memory.push_back(data);
+      data_end.push_back(num_layers);
+      data_can_reuse.push_back(!param_memory.count(data.get()));
+    }
+    const int d = data_group[data.get()];
+    data_end[d] = std::min(data_end[d], first_use[blob_id]);
+    data_can_reuse[d] = data_can_reuse[d] && reuse;
+  }
+  // Walk Backward, handing each diff the smallest free buffer that fits.
+  vector<shared_ptr<SyncedMemory> > free_memory;
+  vector<shared_ptr<SyncedMemory> > diff_memory(diff_blob_ids.size());
+  int num_shared = 0;
+  size_t memory_saved = 0;
+  for (int i = num_layers - 1; i >= 0; --i) {
+    for (int g = 0; g < diff_blob_ids.size(); ++g) {
+      if (!diff_can_reuse[g] || diff_start[g] != i) { continue; }
+      diff_memory[g] = blobs_[diff_blob_ids[g][0]]->diff();
+      int best = -1;
+      for (int k = 0; k < free_memory.size(); ++k) {
+        if (free_memory[k]->size() >= diff_memory[g]->size() &&
+            (best < 0 || free_memory[k]->size() < free_memory[best]->size())) {
+          best = k;
+        }
+      }
+      if (best >= 0) {
+        memory_saved += diff_memory[g]->size();
+        diff_memory[g] = free_memory[best];
+        free_memory.erase(free_memory.begin() + best);
+        for (int j = 0; j < diff_blob_ids[g].size(); ++j) {
+          blobs_[diff_blob_ids[g][j]]->set_diff_memory(diff_memory[g]);
+        }
+        ++num_shared;
+      }
+    }
+    for (int g = 0; g < diff_blob_ids.size(); ++g) {
+      if (diff_memory[g] && diff_end[g] == i) {
+        free_memory.push_back(diff_memory[g]);
+      }
+    }
+    for (int d = 0; d < data_memory.size(); ++d) {
+      if (data_can_reuse[d] && data_end[d] == i) {
+        free_memory.push_back(data_memory[d]);
+      }
+    }
+  }
+  memory_reuse_planned_ = true;
+  if (scheduler_) { ScheduleLayers(); }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Reusing buffers for " << num_shared << " of " << diff_blob_ids.size()
+      << " blob diffs; memory saved: " << memory_saved;
+}
+
+// A blob's memory: its SyncedMemory and offset within it. The views made by
+// zero_copy_concat are told apart by their offsets; they are only accessed
+// through the Concat or Slice layer joining them, which orders them.
+typedef pair<const SyncedMemory*, int> MemoryKey;
+
+template <typename Dtype>
+static MemoryKey DataKey(const Blob<Dtype>& blob) {
+  return std::make_pair(blob.data().get(), blob.data_offset());
+}
+
+template <typename Dtype>
+static MemoryKey DiffKey(const Blob<Dtype>& blob) {
+  return std::make_pair(blob.diff().get(), blob.diff_offset());
+}
+
+// Orders each pair of tasks accessing the same memory, at least one of them
+// writing it, as they come in order; the tasks run on the calling thread are
+// kept in order too.
+static void ScheduleTasks(const vector<int>& order,
+    const vector<vector<MemoryKey> >& reads,
+    const vector<vector<MemoryKey> >& writes,
+    const vector<bool>& on_caller, vector<vector<int> >* successors) {
+  vector<set<int> > edges(order.size());
+  map<MemoryKey, int> last_writer;
+  map<MemoryKey, vector<int> > readers;
+  int last_on_caller = -1;
+  for (int k = 0; k < order.size(); ++k) {
+    const int i = order[k];
+    for (int j = 0; j < reads[i].size(); ++j) {
+      const MemoryKey& memory = reads[i][j];
+      if (last_writer.count(memory) && last_writer[memory] != i) {
+        edges[last_writer[memory]].insert(i);
+      }
+      readers[memory].push_back(i);
+    }
+    for (int j = 0; j < writes[i].size(); ++j) {
+      const MemoryKey& memory = writes[i][j];
+      if (last_writer.count(memory) && last_writer[memory] != i) {
+        edges[last_writer[memory]].insert(i);
+      }
+      const vector<int>& memory_readers = readers[memory];
+      for (int r = 0; r < memory_readers.size(); ++r) {
+        if (memory_readers[r] != i) { edges[memory_readers[r]].insert(i); }
+      }
+      readers[memory].clear();
+      last_writer[memory] = i;
+    }
+    if (on_caller[i]) {
+      if (last_on_caller >= 0) { edges[last_on_caller].insert(i); }
+      last_on_caller = i;
+    }
+  }
+  successors->resize(order.size());
+  for (int i = 0; i < order.size(); ++i) {
+    (*successors)[i].assign(edges[i].begin(), edges[i].end());
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ScheduleLayers() {
+  // Dependencies are found from the memory each layer accesses, so blobs
+  // sharing memory (in-place layers, splits, reused buffers) are handled.
+  const int num_layers = layers_.size();
+  vector<vector<MemoryKey> > forward_reads(num_layers);
+  vector<vector<MemoryKey> > forward_writes(num_layers);
+  vector<vector<MemoryKey> > backward_reads(num_layers);
+  vector<vector<MemoryKey> > backward_writes(num_layers);
+  layer_on_caller_.resize(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    // Data layers may draw random numbers, so they run on the calling thread.
+    layer_on_caller_[i] = bottom_vecs_[i].empty() ||
+        !layers_[i]->AllowParallel();
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      forward_reads[i].push_back(DataKey(*bottom_vecs_[i][j]));
+    }
+    // Layer::Forward reads the loss weights from the top diffs.
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      forward_writes[i].push_back(DataKey(*top_vecs_[i][j]));
+      forward_writes[i].push_back(DiffKey(*top_vecs_[i][j]));
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& layer_blobs = layers_[i]->blobs();
+    for (int j = 0; j < layer_blobs.size(); ++j) {
+      forward_reads[i].push_back(DataKey(*layer_blobs[j]));
+    }
+    if (!layer_need_backward_[i]) { continue; }
+    backward_reads[i] = forward_reads[i];
+    backward_reads[i].insert(backward_reads[i].end(),
+        forward_writes[i].begin(), forward_writes[i].end());
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      if (bottom_need_backward_[i][j]) {
+        backward_writes[i].push_back(DiffKey(*bottom_vecs_[i][j]));
+      }
+    }
+    for (int j = 0; j < layer_blobs.size(); ++j) {
+      backward_writes[i].push_back(DiffKey(*layer_blobs[j]));
+    }
+  }
+  vector<int> order(num_layers);
+  for (int i = 0; i < num_layers; ++i) { order[i] = i; }
+  ScheduleTasks(order, forward_reads, forward_writes, layer_on_caller_,
+      &forward_successors_);
+  std::reverse(order.begin(), order.end());
+  ScheduleTasks(order, backward_reads, backward_writes, layer_on_caller_,
+      &backward_successors_);
+  layer_losses_.resize(num_layers);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardLayer(int layer_id) {
+  layer_losses_[layer_id] =
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardLayer(int layer_id) {
+  if (layer_need_backward_[layer_id]) {
+    layers_[layer_id]->Backward(top_vecs_[layer_id],
+        bottom_need_backward_[layer_id], bottom_vecs_[layer_id]);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -680,6 +1235,8 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  // The cached plans would keep the old weights.
+  plans_.clear();
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -722,6 +1279,9 @@ void Net<Dtype>::BackwardTo(int end) {
 
 template <typename Dtype>
 void Net<Dtype>::Backward() {
+  if (reuse_buffers_ && !memory_reuse_planned_) {
+    PlanMemoryReuse();
+  }
   BackwardFromTo(layers_.size() - 1, 0);
   if (debug_info_) {
     Dtype asum_data = 0, asum_diff = 0, sumsq_data = 0, sumsq_diff = 0;
@@ -741,9 +1301,95 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  if (plan_cache_bytes_ > 0 && SwitchPlan()) { return; }
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (zero_copy_concat_) { ShareConcatMemory(); }
+  if (scheduler_) { ScheduleLayers(); }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::SwitchPlan() {
+  vector<vector<int> > shapes(net_input_blobs_.size());
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    shapes[i] = net_input_blobs_[i]->shape();
+  }
+  if (shapes == plan_shapes_) { return false; }
+  typename std::list<pair<vector<vector<int> >, shared_ptr<Net> > >::iterator
+      it = plans_.begin();
+  while (it != plans_.end() && it->first != shapes) { ++it; }
+  shared_ptr<Net> plan;
+  if (it != plans_.end()) {
+    plan = it->second;
+    plans_.erase(it);
+  } else {
+    LOG(INFO) << "Creating a plan for net " << name_ << " with input shape "
+              << (net_input_blobs_.empty() ? string() :
+                  net_input_blobs_[0]->shape_string());
+    plan.reset(new Net(plan_param_, root_net_));
+    plan->ShareTrainedLayersWith(this);
+    // Use the input blobs of this net in place of those of the plan.
+    for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+      const int blob_id = net_input_blob_indices_[i];
+      Blob<Dtype>* plan_blob = plan->blobs_[blob_id].get();
+      for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+        std::replace(plan->bottom_vecs_[layer_id].begin(),
+            plan->bottom_vecs_[layer_id].end(), plan_blob, net_input_blobs_[i]);
+        std::replace(plan->top_vecs_[layer_id].begin(),
+            plan->top_vecs_[layer_id].end(), plan_blob, net_input_blobs_[i]);
+      }
+      std::replace(plan->net_output_blobs_.begin(),
+          plan->net_output_blobs_.end(), plan_blob, net_input_blobs_[i]);
+      plan->blobs_[blob_id] = blobs_[blob_id];
+      plan->net_input_blobs_[i] = net_input_blobs_[i];
+    }
+    plan->Reshape();
+  }
+  SwapPlan(plan.get());
+  plans_.push_front(make_pair(plan_shapes_, plan));
+  plan_shapes_ = shapes;
+  // Drop the least recently used plans over budget.
+  size_t bytes = PlanBytes();
+  for (it = plans_.begin(); it != plans_.end(); ) {
+    bytes += it->second->PlanBytes();
+    if (bytes > plan_cache_bytes_) {
+      it = plans_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (scheduler_) { ScheduleLayers(); }
+  return true;
+}
+
+template <typename Dtype>
+void Net<Dtype>::SwapPlan(Net* plan) {
+  layers_.swap(plan->layers_);
+  blobs_.swap(plan->blobs_);
+  bottom_vecs_.swap(plan->bottom_vecs_);
+  top_vecs_.swap(plan->top_vecs_);
+  net_output_blobs_.swap(plan->net_output_blobs_);
+  params_.swap(plan->params_);
+  learnable_params_.swap(plan->learnable_params_);
+  std::swap(memory_used_, plan->memory_used_);
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::PlanBytes() const {
+  set<const SyncedMemory*> inputs;
+  for (int i = 0; i < net_input_blobs_.size(); ++i) {
+    inputs.insert(net_input_blobs_[i]->data().get());
+  }
+  set<const SyncedMemory*> counted;
+  size_t bytes = 0;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    SyncedMemory* memory = blobs_[i]->data().get();
+    if (memory && !inputs.count(memory) && counted.insert(memory).second) {
+      bytes += memory->size();
+    }
+  }
+  return bytes;
 }
 
 template <typename Dtype>
@@ -797,9 +1443,89 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  if (!StreamTrainedLayersFromBinaryProto(trained_filename)) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::StreamTrainedLayersFromBinaryProto(
+    const string& trained_filename) {
+  ProtoStreamReader input(trained_filename);
+  int field;
+  while (input.NextField(-1, &field)) {
+    if (field == NetParameter::kLayersFieldNumber) {
+      // V0/V1 layers need the whole NetParameter to be upgraded.
+      return false;
+    }
+    if (field != NetParameter::kLayerFieldNumber) {
+      input.SkipField();
+      continue;
+    }
+    const int64_t layer_end = input.ReadMessageEnd();
+    string source_layer_name;
+    bool has_name = false;
+    int target_layer_id = -1;
+    int num_source_blobs = 0;
+    while (input.NextField(layer_end, &field)) {
+      if (field == LayerParameter::kNameFieldNumber) {
+        source_layer_name = input.ReadString();
+        has_name = true;
+        if (!layer_names_index_.count(source_layer_name)) {
+          LOG(INFO) << "Ignoring source layer " << source_layer_name;
+        } else {
+          target_layer_id = layer_names_index_[source_layer_name];
+          DLOG(INFO) << "Copying source layer " << source_layer_name;
+        }
+      } else if (field == LayerParameter::kBlobsFieldNumber) {
+        if (!has_name) {
+          // Blobs precede the layer name: not written by protobuf or
+          // ToBinaryProto, so leave it to the full parser.
+          return false;
+        }
+        if (target_layer_id < 0) {
+          input.SkipField();
+          continue;
+        }
+        vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+            layers_[target_layer_id]->blobs();
+        const int j = num_source_blobs++;
+        CHECK_LT(j, target_blobs.size())
+            << "Incompatible number of blobs for layer " << source_layer_name;
+        BlobProto source_header;
+        const bool copied = input.ReadBlob(target_blobs[j].get(),
+            &source_header);
+        if (!target_blobs[j]->ShapeEquals(source_header)) {
+          Blob<Dtype> source_blob;
+          if (source_header.has_num() || source_header.has_channels() ||
+              source_header.has_height() || source_header.has_width()) {
+            source_blob.Reshape(source_header.num(), source_header.channels(),
+                source_header.height(), source_header.width());
+          } else {
+            source_blob.Reshape(source_header.shape());
+          }
+          LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+              << source_layer_name << "'; shape mismatch.  "
+              << "Source param shape is " << source_blob.shape_string()
+              << "; target param shape is "
+              << target_blobs[j]->shape_string() << ". "
+              << "To learn this layer's parameters from scratch rather than "
+              << "copying from a saved net, rename the layer.";
+        }
+        CHECK(copied) << "Incorrect data size for param " << j
+            << " of layer " << source_layer_name;
+      } else {
+        input.SkipField();
+      }
+    }
+    if (target_layer_id >= 0) {
+      CHECK_EQ(layers_[target_layer_id]->blobs().size(), num_source_blobs)
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+  }
+  return true;
 }
 
 template <typename Dtype>
@@ -864,8 +1590,50 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToBinaryProto(const string& filename, bool write_diff) const {
+  ParamsToBinaryProto(filename, params_, write_diff);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ParamsToBinaryProto(const string& filename,
+    const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const {
+  CHECK_EQ(params.size(), params_.size());
+  // Same wire format as ToProto, written one layer at a time.
+  ProtoStreamWriter output(filename);
+  NetParameter net_param;
+  net_param.set_name(name_);
+  output.WriteFields(net_param);
+  DLOG(INFO) << "Serializing " << layers_.size() << " layers";
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    LayerParameter layer_param(layers_[layer_id]->layer_param());
+    layer_param.clear_blobs();
+    const vector<int>& param_ids = param_id_vecs_[layer_id];
+    uint64_t layer_size = ProtoStreamWriter::FieldsSize(layer_param);
+    for (int j = 0; j < param_ids.size(); ++j) {
+      layer_size += ProtoStreamWriter::BlobSize(
+          LayerParameter::kBlobsFieldNumber, *params[param_ids[j]],
+          write_diff);
+    }
+    output.WriteLengthDelimited(NetParameter::kLayerFieldNumber, layer_size);
+    output.WriteFields(layer_param);
+    for (int j = 0; j < param_ids.size(); ++j) {
+      output.WriteBlob(LayerParameter::kBlobsFieldNumber,
+          *params[param_ids[j]], write_diff);
+    }
+  }
+  output.Close();
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  ParamsToHDF5(filename, params_, write_diff);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ParamsToHDF5(const string& filename,
+    const vector<shared_ptr<Blob<Dtype> > >& params, bool write_diff) const {
+  CHECK_EQ(params.size(), params_.size());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -901,12 +1669,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
       if (param_owners_[net_param_id] == -1) {
         // Only save params that own themselves
         hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+            *params[net_param_id]);
       }
       if (write_diff) {
         // Write diffs regardless of weight-sharing
         hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+            *params[net_param_id], true);
       }
     }
     H5Gclose(layer_data_hid);
@@ -11,6 +11,8 @@
 #include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -269,6 +271,8 @@ P2PSync<Dtype>::~P2PSync() {
 
 template<typename Dtype>
 void P2PSync<Dtype>::InternalThreadEntry() {
+  Tracer::SetThreadName("Solver on device " +
+      format_int(solver_->param().device_id()));
   Caffe::SetDevice(solver_->param().device_id());
   CHECK(Caffe::root_solver());
   Caffe::set_root_solver(false);
@@ -285,6 +289,7 @@ void P2PSync<Dtype>::InternalThreadEntry() {
 
 template<typename Dtype>
 void P2PSync<Dtype>::on_start() {
+  TraceSpan trace("Broadcast weights", "sync");
 #ifndef CPU_ONLY
 #ifdef DEBUG
   int device;
@@ -323,6 +328,7 @@ void P2PSync<Dtype>::on_start() {
 
 template<typename Dtype>
 void P2PSync<Dtype>::on_gradients_ready() {
+  TraceSpan trace("Reduce gradients", "sync");
 #ifndef CPU_ONLY
 #ifdef DEBUG
   int device;
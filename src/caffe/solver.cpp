@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <cstdio>
 
 #include <string>
@@ -7,6 +8,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -57,6 +59,9 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   InitTrainNet();
   if (Caffe::root_solver()) {
     InitTestNets();
+    if (param_.snapshot_async()) {
+      snapshot_writer_.reset(new SnapshotWriter());
+    }
     LOG(INFO) << "Solver scaffolding done.";
   }
   iter_ = 0;
@@ -199,11 +204,13 @@ void Solver<Dtype>::Step(int iters) {
   smoothed_loss_ = 0;
 
   while (iter_ < stop_iter) {
+    TraceSpan iteration_trace("Iteration", "solver");
     // zero-init the params
     net_->ClearParamDiffs();
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())
         && Caffe::root_solver()) {
+      TraceSpan trace("Test", "solver");
       TestAll();
       if (requested_early_exit_) {
         // Break out of the while loop because stop was requested while testing.
@@ -250,7 +257,10 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    {
+      TraceSpan trace("Update", "solver");
+      ApplyUpdate();
+    }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -263,6 +273,7 @@ void Solver<Dtype>::Step(int iters) {
          && iter_ % param_.snapshot() == 0
          && Caffe::root_solver()) ||
          (request == SolverAction::SNAPSHOT)) {
+      TraceSpan trace("Snapshot", "solver");
       Snapshot();
     }
     if (SolverAction::STOP == request) {
@@ -297,6 +308,9 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -409,6 +423,10 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (snapshot_writer_) {
+    // Keep at most one snapshot staged in memory.
+    snapshot_writer_->Wait();
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -452,9 +470,13 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
+  vector<shared_ptr<Blob<Dtype> > > params = net_->params();
+  if (snapshot_writer_) {
+    params = StageBlobs(params, param_.snapshot_diff());
+  }
+  WriteSnapshotFile(model_filename, boost::bind(
+      &Net<Dtype>::ParamsToBinaryProto, net_, _1, params,
+      param_.snapshot_diff()));
   return model_filename;
 }
 
@@ -462,10 +484,41 @@ template <typename Dtype>
 string Solver<Dtype>::SnapshotToHDF5() {
   string model_filename = SnapshotFilename(".caffemodel.h5");
   LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
+  vector<shared_ptr<Blob<Dtype> > > params = net_->params();
+  if (snapshot_writer_) {
+    params = StageBlobs(params, param_.snapshot_diff());
+  }
+  WriteSnapshotFile(model_filename, boost::bind(&Net<Dtype>::ParamsToHDF5,
+      net_, _1, params, param_.snapshot_diff()));
   return model_filename;
 }
 
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshotFile(const string& filename,
+    const SnapshotWriter::FileWriter& writer) {
+  if (snapshot_writer_) {
+    snapshot_writer_->Write(filename, writer);
+  } else {
+    writer(filename);
+  }
+}
+
+template <typename Dtype>
+vector<shared_ptr<Blob<Dtype> > > Solver<Dtype>::StageBlobs(
+    const vector<shared_ptr<Blob<Dtype> > >& blobs, bool copy_diff) {
+  vector<shared_ptr<Blob<Dtype> > > staged(blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    staged[i].reset(new Blob<Dtype>(blobs[i]->shape()));
+    caffe_copy(blobs[i]->count(), blobs[i]->cpu_data(),
+        staged[i]->mutable_cpu_data());
+    if (copy_diff) {
+      caffe_copy(blobs[i]->count(), blobs[i]->cpu_diff(),
+          staged[i]->mutable_cpu_diff());
+    }
+  }
+  return staged;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
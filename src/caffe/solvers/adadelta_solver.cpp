@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/memory_tracker.hpp"
 
 namespace caffe {
 
@@ -9,6 +10,7 @@ void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
   // Add the extra history entries for AdaDelta after those from
   // SGDSolver::PreSolve
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  MemoryTracker::Scope memory_scope("solver", MemoryTracker::SOLVER_HISTORY);
   for (int i = 0; i < net_params.size(); ++i) {
         const vector<int>& shape = net_params[i]->shape();
         this->history_.push_back(
@@ -106,6 +108,28 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  Dtype* w = this->fused_data(param_id);
+  Dtype* g = this->fused_diff(param_id);
+  Dtype* h = this->fused_history(0, param_id);
+  Dtype* h2 = this->fused_history(1, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = grad(w[i], g[i]);
+    const Dtype hi = h[i] = momentum * h[i] + (1 - momentum) * gi * gi;
+    gi = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * gi * gi;
+    g[i] = local_rate * gi;
+    w[i] -= g[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
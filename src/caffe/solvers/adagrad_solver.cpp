@@ -64,6 +64,24 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype delta = this->param_.delta();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  Dtype* w = this->fused_data(param_id);
+  Dtype* g = this->fused_diff(param_id);
+  Dtype* h = this->fused_history(0, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = grad(w[i], g[i]);
+    const Dtype hi = h[i] = h[i] + gi * gi;
+    g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+    w[i] -= g[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
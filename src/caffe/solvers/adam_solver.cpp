@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/memory_tracker.hpp"
 
 namespace caffe {
 
@@ -9,6 +10,7 @@ void AdamSolver<Dtype>::AdamPreSolve() {
   // Add the extra history entries for Adam after those from
   // SGDSolver::PreSolve
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  MemoryTracker::Scope memory_scope("solver", MemoryTracker::SOLVER_HISTORY);
   for (int i = 0; i < net_params.size(); ++i) {
     const vector<int>& shape = net_params[i]->shape();
     this->history_.push_back(
@@ -88,6 +90,32 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const Dtype corrected_local_rate = local_rate * correction;
+  const Dtype eps_hat = this->param_.delta();
+  Dtype* w = this->fused_data(param_id);
+  Dtype* g = this->fused_diff(param_id);
+  Dtype* m = this->fused_history(0, param_id);
+  Dtype* v = this->fused_history(1, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = grad(w[i], g[i]);
+    const Dtype mi = m[i] = m[i] * beta1 + gi * (1 - beta1);
+    const Dtype vi = v[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+    g[i] = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    w[i] -= g[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
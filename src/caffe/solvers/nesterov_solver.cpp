@@ -56,6 +56,24 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  Dtype* w = this->fused_data(param_id);
+  Dtype* g = this->fused_diff(param_id);
+  Dtype* h = this->fused_history(0, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i];
+    const Dtype hi_new = h[i] = momentum * hi + local_rate * grad(w[i], g[i]);
+    g[i] = (1 + momentum) * hi_new - momentum * hi;
+    w[i] -= g[i];
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
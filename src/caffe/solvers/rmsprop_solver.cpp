@@ -64,6 +64,25 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype delta = this->param_.delta();
+  const Dtype rms_decay = this->param_.rms_decay();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  Dtype* w = this->fused_data(param_id);
+  Dtype* g = this->fused_diff(param_id);
+  Dtype* h = this->fused_history(0, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = grad(w[i], g[i]);
+    const Dtype hi = h[i] = rms_decay * h[i] + (1 - rms_decay) * gi * gi;
+    g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+    w[i] -= g[i];
+  }
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
@@ -1,9 +1,13 @@
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/memory_tracker.hpp"
+#include "caffe/util/proto_stream.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -66,6 +70,7 @@ template <typename Dtype>
 void SGDSolver<Dtype>::PreSolve() {
   // Initialize the history
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  MemoryTracker::Scope memory_scope("solver", MemoryTracker::SOLVER_HISTORY);
   history_.clear();
   update_.clear();
   temp_.clear();
@@ -75,6 +80,11 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  fused_data_.reset();
+  fused_diff_.reset();
+  fused_history_.reset();
+  fused_offset_.clear();
+  fused_count_ = 0;
 }
 
 template <typename Dtype>
@@ -105,6 +115,10 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  if (this->param_.fused_update() && Caffe::mode() == Caffe::CPU) {
+    ApplyFusedUpdate(rate);
+    return;
+  }
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
@@ -115,6 +129,84 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+// Move the learnable params' data and diff and the history blobs into
+// contiguous buffers laid out param by param, so that the fused update can
+// stream through them. The blobs keep pointing at their slice of the buffers.
+template <typename Dtype>
+void SGDSolver<Dtype>::InitFusedUpdate() {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  fused_offset_.resize(net_params.size());
+  fused_count_ = 0;
+  for (int i = 0; i < net_params.size(); ++i) {
+    fused_offset_[i] = fused_count_;
+    fused_count_ += net_params[i]->count();
+  }
+  CHECK_EQ(history_.size() % std::max<size_t>(net_params.size(), 1), 0);
+  const int history_slots = net_params.size() ?
+      history_.size() / net_params.size() : 0;
+  // Allocate at least one element so that nets without params work.
+  const size_t bytes = std::max<size_t>(fused_count_, 1) * sizeof(Dtype);
+  MemoryTracker* tracker = MemoryTracker::Get();
+  fused_data_.reset(new SyncedMemory(bytes));
+  fused_data_->set_account(tracker->account("solver", MemoryTracker::PARAMS));
+  fused_diff_.reset(new SyncedMemory(bytes));
+  fused_diff_->set_account(tracker->account("solver", MemoryTracker::PARAMS));
+  fused_history_.reset(new SyncedMemory(
+      std::max(history_slots, 1) * bytes));
+  fused_history_->set_account(
+      tracker->account("solver", MemoryTracker::SOLVER_HISTORY));
+  for (int i = 0; i < net_params.size(); ++i) {
+    const int count = net_params[i]->count();
+    caffe_copy(count, net_params[i]->cpu_data(), fused_data(i));
+    net_params[i]->data()->set_cpu_data(fused_data(i));
+    caffe_copy(count, net_params[i]->cpu_diff(), fused_diff(i));
+    net_params[i]->diff()->set_cpu_data(fused_diff(i));
+    for (int slot = 0; slot < history_slots; ++slot) {
+      Blob<Dtype>* history = history_[slot * net_params.size() + i].get();
+      caffe_copy(count, history->cpu_data(), fused_history(slot, i));
+      history->data()->set_cpu_data(fused_history(slot, i));
+    }
+  }
+}
+
+// Apply clipping, normalization, regularization and the update in one sweep
+// per param. The clipping norm still needs its own pass over the gradients,
+// but it is a single dot product over the contiguous diff buffer. As with
+// Net::Update the param diffs are left holding the applied update values.
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyFusedUpdate(Dtype rate) {
+  if (!fused_data_) {
+    InitFusedUpdate();
+  }
+  FusedGradient<Dtype> grad;
+  grad.scale = Dtype(1) / this->param_.iter_size();
+  const Dtype clip_gradients = this->param_.clip_gradients();
+  if (clip_gradients >= 0) {
+    const Dtype* diff = static_cast<const Dtype*>(fused_diff_->cpu_data());
+    const Dtype l2norm_diff =
+        std::sqrt(caffe_cpu_dot(fused_count_, diff, diff));
+    if (l2norm_diff > clip_gradients) {
+      Dtype scale_factor = clip_gradients / l2norm_diff;
+      LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
+          << l2norm_diff << " > " << clip_gradients << ") "
+          << "by scale factor " << scale_factor;
+      grad.scale *= scale_factor;
+    }
+  }
+  const string& regularization_type = this->param_.regularization_type();
+  if (regularization_type != "L1" && regularization_type != "L2") {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  grad.l1 = (regularization_type == "L1");
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  for (int param_id = 0; param_id < fused_offset_.size(); ++param_id) {
+    grad.decay = this->param_.weight_decay() *
+        net_params_weight_decay[param_id];
+    ComputeFusedUpdateValue(param_id, rate, grad);
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -242,6 +334,22 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeFusedUpdateValue(int param_id, Dtype rate,
+    const FusedGradient<Dtype>& grad) {
+  const int N = this->net_->learnable_params()[param_id]->count();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  Dtype* w = fused_data(param_id);
+  Dtype* g = fused_diff(param_id);
+  Dtype* h = fused_history(0, param_id);
+#pragma omp parallel for
+  for (int i = 0; i < N; ++i) {
+    g[i] = h[i] = momentum * h[i] + local_rate * grad(w[i], g[i]);
+    w[i] -= g[i];
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
@@ -257,67 +365,116 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
+static void WriteSolverStateToBinaryProto(const string& snapshot_filename,
+    int iter, const string& model_filename, int current_step,
+    const vector<shared_ptr<Blob<Dtype> > >& history) {
+  // Same wire format as a SolverState, with the history streamed to disk.
+  ProtoStreamWriter output(snapshot_filename);
   SolverState state;
-  state.set_iter(this->iter_);
+  state.set_iter(iter);
   state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
-  for (int i = 0; i < history_.size(); ++i) {
-    // Add history
-    BlobProto* history_blob = state.add_history();
-    history_[i]->ToProto(history_blob);
+  state.set_current_step(current_step);
+  output.WriteFields(state);
+  for (int i = 0; i < history.size(); ++i) {
+    output.WriteBlob(SolverState::kHistoryFieldNumber, *history[i], false);
   }
+  output.Close();
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
+    const string& model_filename) {
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  vector<shared_ptr<Blob<Dtype> > > history = history_;
+  if (this->snapshot_writer_) {
+    history = this->StageBlobs(history_, false);
+  }
+  this->WriteSnapshotFile(snapshot_filename,
+      boost::bind(&WriteSolverStateToBinaryProto<Dtype>, _1, this->iter_,
+          model_filename, this->current_step_, history));
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
-    const string& model_filename) {
-  string snapshot_filename =
-      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
-  LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+static void WriteSolverStateToHDF5(const string& snapshot_filename,
+    int iter, const string& model_filename, int current_step,
+    const vector<shared_ptr<Blob<Dtype> > >& history) {
   hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
       H5P_DEFAULT, H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
       << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
+  hdf5_save_int(file_hid, "iter", iter);
   hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
+  hdf5_save_int(file_hid, "current_step", current_step);
   hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(history_hid, 0)
       << "Error saving solver state to " << snapshot_filename << ".";
-  for (int i = 0; i < history_.size(); ++i) {
+  for (int i = 0; i < history.size(); ++i) {
     ostringstream oss;
     oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
+    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history[i]);
   }
   H5Gclose(history_hid);
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
+    const string& model_filename) {
+  string snapshot_filename =
+      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
+  LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
+  vector<shared_ptr<Blob<Dtype> > > history = history_;
+  if (this->snapshot_writer_) {
+    history = this->StageBlobs(history_, false);
+  }
+  this->WriteSnapshotFile(snapshot_filename,
+      boost::bind(&WriteSolverStateToHDF5<Dtype>, _1, this->iter_,
+          model_filename, this->current_step_, history));
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
     const string& state_file) {
-  SolverState state;
-  ReadProtoFromBinaryFile(state_file, &state);
-  this->iter_ = state.iter();
-  if (state.has_learned_net()) {
-    NetParameter net_param;
-    ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
-    this->net_->CopyTrainedLayersFrom(net_param);
-  }
-  this->current_step_ = state.current_step();
-  CHECK_EQ(state.history_size(), history_.size())
+  ProtoStreamReader input(state_file);
+  string learned_net;
+  int num_history = 0;
+  this->iter_ = 0;
+  this->current_step_ = 0;
+  int field;
+  while (input.NextField(-1, &field)) {
+    switch (field) {
+    case SolverState::kIterFieldNumber:
+      this->iter_ = input.ReadInt32();
+      break;
+    case SolverState::kLearnedNetFieldNumber:
+      learned_net = input.ReadString();
+      break;
+    case SolverState::kCurrentStepFieldNumber:
+      this->current_step_ = input.ReadInt32();
+      break;
+    case SolverState::kHistoryFieldNumber: {
+      if (num_history == 0) {
+        LOG(INFO) << "SGDSolver: restoring history";
+      }
+      CHECK_LT(num_history, history_.size())
+          << "Incorrect length of history blobs.";
+      BlobProto header;
+      CHECK(input.ReadBlob(history_[num_history].get(), &header))
+          << "Incorrect size of history blob " << num_history;
+      ++num_history;
+      break;
+    }
+    default:
+      input.SkipField();
+    }
+  }
+  CHECK_EQ(num_history, history_.size())
       << "Incorrect length of history blobs.";
-  LOG(INFO) << "SGDSolver: restoring history";
-  for (int i = 0; i < history_.size(); ++i) {
-    history_[i]->FromProto(state.history(i));
+  if (!learned_net.empty()) {
+    this->net_->CopyTrainedLayersFromBinaryProto(learned_net);
   }
 }
 
@@ -6,7 +6,7 @@ namespace caffe {
 
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost();
   }
 
 #ifndef CPU_ONLY
@@ -22,19 +22,36 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+void SyncedMemory::AllocateHost() {
+  host_allocator_ = HostAllocator::Get();
+  CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_, host_allocator_);
+  own_cpu_data_ = true;
+  MemoryTracker::Get()->Allocate(account_, size_);
+}
+
+void SyncedMemory::FreeHost() {
+  CaffeFreeHost(cpu_ptr_, size_, cpu_malloc_use_cuda_, host_allocator_);
+  MemoryTracker::Get()->Free(account_, size_);
+}
+
+void SyncedMemory::set_account(MemoryTracker::Account* account) {
+  if (cpu_ptr_ && own_cpu_data_) {
+    MemoryTracker::Get()->Move(account_, account, size_);
+  }
+  account_ = account;
+}
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    AllocateHost();
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
-    own_cpu_data_ = true;
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-      own_cpu_data_ = true;
+      AllocateHost();
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
     head_ = SYNCED;
@@ -84,7 +101,7 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    FreeHost();
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
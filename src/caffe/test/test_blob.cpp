@@ -59,6 +59,34 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareDataOffset) {
+  Blob<TypeParam> view(2, 3, 2, 5);
+  view.ShareData(*this->blob_preshaped_, 60);
+  view.ShareDiff(*this->blob_preshaped_, 0);
+  EXPECT_EQ(view.data(), this->blob_preshaped_->data());
+  EXPECT_EQ(view.cpu_data(), this->blob_preshaped_->cpu_data() + 60);
+  EXPECT_EQ(view.cpu_diff(), this->blob_preshaped_->cpu_diff());
+  view.mutable_cpu_data()[0] = 7;
+  EXPECT_EQ(7, this->blob_preshaped_->cpu_data()[60]);
+  // Shrinking keeps the view; growing gives the blob memory of its own.
+  view.Reshape(2, 3, 1, 5);
+  EXPECT_EQ(view.cpu_data(), this->blob_preshaped_->cpu_data() + 60);
+  view.Reshape(2, 3, 4, 5);
+  EXPECT_NE(view.data(), this->blob_preshaped_->data());
+  EXPECT_EQ(0, view.data_offset());
+  EXPECT_EQ(0, view.diff_offset());
+  // Sharing a view shares its offset.
+  Blob<TypeParam> other(2, 3, 2, 5);
+  view.Reshape(2, 3, 2, 5);
+  view.ShareData(*this->blob_preshaped_, 60);
+  other.ShareData(view);
+  EXPECT_EQ(other.cpu_data(), view.cpu_data());
+  // Unshare copies the data out of the view.
+  view.Unshare(true);
+  EXPECT_NE(view.data(), this->blob_preshaped_->data());
+  EXPECT_EQ(7, view.cpu_data()[0]);
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
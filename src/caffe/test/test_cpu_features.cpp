@@ -0,0 +1,111 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/cpu_features.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/vector_math.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPUFeaturesTest : public ::testing::Test {
+ protected:
+  CPUFeaturesTest()
+      : isa_(cpu_isa()),
+        blob_a_(new Blob<float>(2, 3, 7, 9)),
+        blob_b_(new Blob<float>(2, 3, 7, 9)) {
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(blob_a_);
+    filler.Fill(blob_b_);
+  }
+  virtual ~CPUFeaturesTest() {
+    set_cpu_isa(isa_);
+    delete blob_a_;
+    delete blob_b_;
+  }
+
+  // The outputs of the dispatched kernels with the current instruction set.
+  vector<float> RunKernels() {
+    const int n = blob_a_->count();
+    const float* a = blob_a_->cpu_data();
+    const float* b = blob_b_->cpu_data();
+    vector<float> outputs;
+    vector<float> y(n);
+    caffe_add(n, a, b, &y[0]);
+    outputs.insert(outputs.end(), y.begin(), y.end());
+    caffe_div(n, a, b, &y[0]);
+    outputs.insert(outputs.end(), y.begin(), y.end());
+    caffe_sqr(n, a, &y[0]);
+    outputs.insert(outputs.end(), y.begin(), y.end());
+    // A 3x3 convolution with padding 1 and stride 2.
+    vector<float> col(6 * 9 * 4 * 5);
+    im2col_cpu(a, 6, 7, 9, 3, 3, 1, 1, 2, 2, 1, 1, &col[0]);
+    outputs.insert(outputs.end(), col.begin(), col.end());
+    col2im_cpu(&col[0], 6, 7, 9, 3, 3, 1, 1, 2, 2, 1, 1, &y[0]);
+    outputs.insert(outputs.end(), y.begin(), y.end());
+    LayerParameter layer_param;
+    layer_param.mutable_relu_param()->set_negative_slope(0.25);
+    ReLULayer<float> relu(layer_param);
+    Blob<float> top;
+    vector<Blob<float>*> bottom_vec(1, blob_a_);
+    vector<Blob<float>*> top_vec(1, &top);
+    relu.SetUp(bottom_vec, top_vec);
+    relu.Forward(bottom_vec, top_vec);
+    outputs.insert(outputs.end(), top.cpu_data(), top.cpu_data() + n);
+    return outputs;
+  }
+
+  const CPUISA isa_;
+  Blob<float>* const blob_a_;
+  Blob<float>* const blob_b_;
+};
+
+TEST_F(CPUFeaturesTest, TestDetect) {
+  EXPECT_LE(cpu_isa(), DetectCPUISA());
+  EXPECT_EQ(string("generic"), CPUISAName(CPU_ISA_GENERIC));
+  EXPECT_EQ(string("avx512"), CPUISAName(CPU_ISA_AVX512));
+  set_cpu_isa(CPU_ISA_GENERIC);
+  EXPECT_EQ(CPU_ISA_GENERIC, cpu_isa());
+}
+
+TEST_F(CPUFeaturesTest, TestKernelsAgree) {
+  // The kernels above compute the same thing with every instruction set.
+  set_cpu_isa(CPU_ISA_GENERIC);
+  const vector<float> expected = RunKernels();
+  for (int isa = CPU_ISA_SSE4; isa <= DetectCPUISA(); ++isa) {
+    set_cpu_isa(static_cast<CPUISA>(isa));
+    const vector<float> actual = RunKernels();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i], actual[i]) << CPUISAName(cpu_isa());
+    }
+  }
+}
+
+TEST_F(CPUFeaturesTest, TestVectorMathAgrees) {
+  // Only rounding differs, as FMA contracts the polynomials.
+  const int n = blob_a_->count();
+  const float* a = blob_a_->cpu_data();
+  vector<float> expected(n);
+  set_cpu_isa(CPU_ISA_GENERIC);
+  vector_tanh(n, a, &expected[0]);
+  for (int isa = CPU_ISA_SSE4; isa <= DetectCPUISA(); ++isa) {
+    set_cpu_isa(static_cast<CPUISA>(isa));
+    vector<float> actual(n);
+    vector_tanh(n, a, &actual[0]);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(expected[i], actual[i], 1e-6);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,127 @@
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Counts the allocations of the default allocator.
+class CountingAllocator : public HostAllocator {
+ public:
+  CountingAllocator() : allocations_(0), frees_(0) {}
+  virtual void* Allocate(size_t size) {
+    ++allocations_;
+    return base_.Allocate(size);
+  }
+  virtual void Free(void* ptr, size_t size) {
+    ++frees_;
+    base_.Free(ptr, size);
+  }
+  int allocations_;
+  int frees_;
+
+ private:
+  AlignedAllocator base_;
+};
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    HostAllocator::Set(shared_ptr<HostAllocator>());
+  }
+};
+
+TEST_F(HostAllocatorTest, TestAligned) {
+  AlignedAllocator allocator;
+  for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+    void* ptr = allocator.Allocate(size);
+    ASSERT_TRUE(ptr);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % 64);
+    caffe_memset(size, 1, ptr);
+    allocator.Free(ptr, size);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestHugePages) {
+  const size_t huge_page_size = 2 << 20;
+  AlignedAllocator transparent(64, AlignedAllocator::TRANSPARENT);
+  // Explicit huge pages fall back to aligned memory if none are reserved.
+  AlignedAllocator explicit_pages(64, AlignedAllocator::EXPLICIT);
+  for (size_t size = 100; size < 3 * huge_page_size; size += huge_page_size) {
+    void* ptr = transparent.Allocate(size);
+    ASSERT_TRUE(ptr);
+    caffe_memset(size, 1, ptr);
+#ifdef __linux__
+    if (size >= huge_page_size) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % huge_page_size);
+    }
+#endif
+    transparent.Free(ptr, size);
+    ptr = explicit_pages.Allocate(size);
+    ASSERT_TRUE(ptr);
+    caffe_memset(size, 1, ptr);
+    explicit_pages.Free(ptr, size);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestSizeClass) {
+  EXPECT_EQ(64, PoolingAllocator::SizeClass(1));
+  EXPECT_EQ(64, PoolingAllocator::SizeClass(64));
+  EXPECT_EQ(80, PoolingAllocator::SizeClass(65));
+  EXPECT_EQ(1024, PoolingAllocator::SizeClass(1000));
+  EXPECT_EQ(1024, PoolingAllocator::SizeClass(1024));
+  EXPECT_EQ(1280, PoolingAllocator::SizeClass(1025));
+  for (size_t size = 1; size < 1000000; size = size * 3 + 1) {
+    EXPECT_GE(PoolingAllocator::SizeClass(size), size);
+    EXPECT_LE(PoolingAllocator::SizeClass(size), size * 5 / 4 + 64);
+  }
+}
+
+TEST_F(HostAllocatorTest, TestPooling) {
+  shared_ptr<CountingAllocator> base(new CountingAllocator());
+  PoolingAllocator allocator(base, 4096);
+  void* ptr = allocator.Allocate(1000);
+  allocator.Free(ptr, 1000);
+  EXPECT_EQ(1024, allocator.cached_bytes());
+  // The same size class reuses the cached block.
+  EXPECT_EQ(ptr, allocator.Allocate(900));
+  EXPECT_EQ(1, allocator.hits());
+  EXPECT_EQ(1, allocator.misses());
+  EXPECT_EQ(1, base->allocations_);
+  allocator.Free(ptr, 900);
+  // Blocks beyond the cache limit are freed.
+  void* large = allocator.Allocate(8192);
+  allocator.Free(large, 8192);
+  EXPECT_EQ(1024, allocator.cached_bytes());
+  EXPECT_EQ(1, base->frees_);
+  allocator.Trim();
+  EXPECT_EQ(0, allocator.cached_bytes());
+  EXPECT_EQ(2, base->frees_);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemory) {
+  shared_ptr<CountingAllocator> allocator(new CountingAllocator());
+  {
+    SyncedMemory mem(100);
+    HostAllocator::Set(allocator);
+    {
+      SyncedMemory counted(100);
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(counted.cpu_data()) % 64);
+      EXPECT_EQ(1, allocator->allocations_);
+    }
+    EXPECT_EQ(1, allocator->frees_);
+    // Memory is freed by the allocator that allocated it.
+    mem.cpu_data();
+    HostAllocator::Set(shared_ptr<HostAllocator>());
+  }
+  EXPECT_EQ(2, allocator->allocations_);
+  EXPECT_EQ(2, allocator->frees_);
+}
+
+}  // namespace caffe
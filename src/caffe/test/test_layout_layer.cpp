@@ -0,0 +1,271 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/layout_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/insert_layouts.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class LayoutLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  LayoutLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_2_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~LayoutLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_2_;
+  }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_2_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(LayoutLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(LayoutLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  LayoutLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->shape(), this->blob_bottom_->shape());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int spatial_dim = 4 * 5;
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        EXPECT_EQ(this->blob_bottom_->cpu_data()[(n * 3 + c) * spatial_dim + s],
+            this->blob_top_->cpu_data()[(n * spatial_dim + s) * 3 + c]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestRoundTrip) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  LayoutLayer<Dtype> to_nhwc(layer_param);
+  to_nhwc.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  to_nhwc.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_param.mutable_layout_param()->set_layout(LayoutParameter_Layout_NCHW);
+  LayoutLayer<Dtype> to_nchw(layer_param);
+  vector<Blob<Dtype>*> top_vec(1, this->blob_top_2_);
+  to_nchw.SetUp(this->blob_top_vec_, top_vec);
+  to_nchw.Forward(this->blob_top_vec_, top_vec);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_2_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  for (int layout = 0; layout < 2; ++layout) {
+    layer_param.mutable_layout_param()->set_layout(
+        static_cast<LayoutParameter_Layout>(layout));
+    LayoutLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestNHWCNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() == Caffe::GPU) { return; }  // NHWC is CPU only.
+  const string proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { num_output: 4 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } "
+      "} "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+      "layer { "
+      "  name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2' "
+      "  convolution_param { num_output: 5 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } "
+      "} "
+      "layer { "
+      "  name: 'conv3' type: 'Convolution' bottom: 'conv1' top: 'conv3' "
+      "  convolution_param { num_output: 5 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } "
+      "} "
+      "layer { "
+      "  name: 'sum' type: 'Eltwise' bottom: 'conv2' bottom: 'conv3' "
+      "  top: 'sum' "
+      "} "
+      "layer { "
+      "  name: 'pool' type: 'Pooling' bottom: 'sum' top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> nchw_net(param);
+  param.set_internal_layout(LayoutParameter_Layout_NHWC);
+  Net<Dtype> nhwc_net(param);
+  NetParameter weights;
+  nchw_net.ToProto(&weights);
+  nhwc_net.CopyTrainedLayersFrom(weights);
+  // The data goes in and out channels-first, and only the Eltwise output
+  // needs converting back.
+  int layouts = 0;
+  for (int i = 0; i < nhwc_net.layers().size(); ++i) {
+    layouts += string(nhwc_net.layers()[i]->type()) == "Layout";
+  }
+  EXPECT_EQ(2, layouts);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(nchw_net.blob_by_name("data").get());
+  nhwc_net.blob_by_name("data")->CopyFrom(*nchw_net.blob_by_name("data"));
+  nchw_net.Forward();
+  nhwc_net.Forward();
+  const Blob<Dtype>& expected = *nchw_net.blob_by_name("pool");
+  const Blob<Dtype>& actual = *nhwc_net.blob_by_name("pool");
+  ASSERT_EQ(expected.shape(), actual.shape());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i], 1e-4);
+  }
+}
+
+class LayoutInsertionTest : public ::testing::Test {
+ protected:
+  void RunInsertionTest(
+      const string& input_param_string, const string& output_param_string) {
+    // Test that InsertLayouts called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    InsertLayouts(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+  }
+};
+
+TEST_F(LayoutInsertionTest, TestNoInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 1 } "
+      "} "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } ";
+  this->RunInsertionTest(input_proto, input_proto);
+}
+
+TEST_F(LayoutInsertionTest, TestInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "internal_layout: NHWC "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'relu0' type: 'ReLU' bottom: 'data' top: 'data' } "
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 1 } "
+      "} "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+      "layer { "
+      "  name: 'conv3x3' type: 'Convolution' bottom: 'conv' top: 'conv3x3' "
+      "  convolution_param { num_output: 4 kernel_size: 3 } "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "internal_layout: NHWC "
+      "layer { name: 'data' type: 'Input' top: 'data' } "
+      "layer { name: 'relu0' type: 'ReLU' bottom: 'data' top: 'data' } "
+      "layer { "
+      "  name: 'data_nhwc_layout' type: 'Layout' bottom: 'data' "
+      "  top: 'data_nhwc' layout_param { layout: NHWC } "
+      "} "
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data_nhwc' "
+      "  top: 'conv_nhwc' "
+      "  convolution_param { num_output: 4 kernel_size: 1 engine: CAFFE "
+      "    layout: NHWC } "
+      "} "
+      "layer { "
+      "  name: 'relu' type: 'ReLU' bottom: 'conv_nhwc' top: 'conv_nhwc' "
+      "} "
+      "layer { "
+      "  name: 'conv_layout' type: 'Layout' bottom: 'conv_nhwc' top: 'conv' "
+      "  layout_param { layout: NCHW } "
+      "} "
+      "layer { "
+      "  name: 'conv3x3' type: 'Convolution' bottom: 'conv' top: 'conv3x3' "
+      "  convolution_param { num_output: 4 kernel_size: 3 } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(LayoutInsertionTest, TestOutputs) {
+  // The outputs of the net are converted back under their own names.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "internal_layout: NHWC "
+      "input: 'data' "
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 1 } "
+      "} "
+      "layer { name: 'sig' type: 'Sigmoid' bottom: 'conv' top: 'sig' } ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "internal_layout: NHWC "
+      "input: 'data' "
+      "layer { "
+      "  name: 'data_nhwc_layout' type: 'Layout' bottom: 'data' "
+      "  top: 'data_nhwc' layout_param { layout: NHWC } "
+      "} "
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data_nhwc' "
+      "  top: 'conv_nhwc' "
+      "  convolution_param { num_output: 4 kernel_size: 1 engine: CAFFE "
+      "    layout: NHWC } "
+      "} "
+      "layer { name: 'sig' type: 'Sigmoid' bottom: 'conv_nhwc' "
+      "  top: 'sig_nhwc' } "
+      "layer { "
+      "  name: 'sig_layout' type: 'Layout' bottom: 'sig_nhwc' top: 'sig' "
+      "  layout_param { layout: NCHW } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+}  // namespace caffe
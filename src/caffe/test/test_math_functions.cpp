@@ -1,6 +1,9 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -8,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/vector_math.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -119,6 +123,142 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+// The single precision functions are approximations, within a few ULP.
+template <typename Dtype>
+void ExpectNearRelative(const Dtype expected, const Dtype actual) {
+  const Dtype tolerance = sizeof(Dtype) == 4 ? 4e-7 : 1e-14;
+  EXPECT_NEAR(expected, actual,
+      tolerance * std::max(std::fabs(expected), Dtype(1e-30)));
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestExp) {
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_scal<TypeParam>(n, 20, x);
+  caffe_exp<TypeParam>(n, x, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    ExpectNearRelative<TypeParam>(std::exp(x[i]), y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestLog) {
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_abs<TypeParam>(n, x, x);
+  caffe_log<TypeParam>(n, x, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    ExpectNearRelative<TypeParam>(std::log(x[i]), y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestPowx) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  // Only the integer exponents allow negative bases.
+  const TypeParam exponents[] = {3, -2, 0.5, 2, 1, 0, -1};
+  for (int j = 0; j < sizeof(exponents) / sizeof(exponents[0]); ++j) {
+    caffe_powx<TypeParam>(n, x, exponents[j], y);
+    for (int i = 0; i < n; ++i) {
+      if (exponents[j] == 0.5 && x[i] < 0) {
+        EXPECT_TRUE(std::isnan(y[i]));
+      } else {
+        ExpectNearRelative<TypeParam>(std::pow(x[i], exponents[j]), y[i]);
+      }
+    }
+  }
+  TypeParam* ax = this->blob_top_->mutable_cpu_data();
+  caffe_abs<TypeParam>(n, x, ax);
+  caffe_powx<TypeParam>(n, ax, TypeParam(-0.75), y);
+  for (int i = 0; i < n; ++i) {
+    ExpectNearRelative<TypeParam>(std::pow(ax[i], TypeParam(-0.75)), y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestTanh) {
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_scal<TypeParam>(n, 3, x);
+  caffe_tanh<TypeParam>(n, x, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    ExpectNearRelative<TypeParam>(std::tanh(x[i]), y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestSigmoid) {
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_scal<TypeParam>(n, 30, x);
+  caffe_sigmoid<TypeParam>(n, x, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    ExpectNearRelative<TypeParam>(1 / (1 + std::exp(-x[i])), y[i]);
+  }
+}
+
+TEST(VectorMathTest, TestSpecialValues) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float x[] = {-inf, inf, nan, -0.f, 0.f, -1.f, 1e-40f, -100.f, 100.f};
+  const int n = sizeof(x) / sizeof(x[0]);
+  vector<float> results(n);
+  float* y = &results[0];
+  vector_exp(n, x, y);
+  EXPECT_EQ(0, y[0]);
+  EXPECT_EQ(inf, y[1]);
+  EXPECT_TRUE(std::isnan(y[2]));
+  EXPECT_EQ(1, y[3]);
+  EXPECT_EQ(1, y[4]);
+  EXPECT_FLOAT_EQ(std::exp(-1.f), y[5]);
+  EXPECT_EQ(1, y[6]);
+  EXPECT_EQ(inf, y[8]);
+  // Results in the denormal range.
+  float denormal = -100.f;
+  vector_exp(1, &denormal, &denormal);
+  EXPECT_NEAR(std::exp(-100.f), denormal, 1e-45);
+  vector_log(n, x, y);
+  EXPECT_TRUE(std::isnan(y[0]));
+  EXPECT_EQ(inf, y[1]);
+  EXPECT_TRUE(std::isnan(y[2]));
+  EXPECT_EQ(-inf, y[3]);
+  EXPECT_EQ(-inf, y[4]);
+  EXPECT_TRUE(std::isnan(y[5]));
+  EXPECT_FLOAT_EQ(std::log(1e-40f), y[6]);
+  vector_tanh(n, x, y);
+  EXPECT_EQ(-1, y[0]);
+  EXPECT_EQ(1, y[1]);
+  EXPECT_TRUE(std::isnan(y[2]));
+  EXPECT_TRUE(std::signbit(y[3]));
+  EXPECT_EQ(0, y[4]);
+  EXPECT_EQ(1e-40f, y[6]);
+  EXPECT_EQ(-1, y[7]);
+  EXPECT_EQ(1, y[8]);
+  vector_sigmoid(n, x, y);
+  EXPECT_EQ(0, y[0]);
+  EXPECT_EQ(1, y[1]);
+  EXPECT_TRUE(std::isnan(y[2]));
+  EXPECT_EQ(0.5, y[4]);
+  EXPECT_NEAR(std::exp(-100.f), y[7], 1e-45);
+  EXPECT_EQ(1, y[8]);
+  vector_powx(n, x, 3, y);
+  EXPECT_EQ(-inf, y[0]);
+  EXPECT_EQ(inf, y[1]);
+  EXPECT_TRUE(std::isnan(y[2]));
+  EXPECT_EQ(0, y[3]);
+  EXPECT_TRUE(std::signbit(y[3]));
+  EXPECT_EQ(-1, y[5]);
+  EXPECT_EQ(0, y[6]);
+  vector_powx(n, x, -0.5, y);
+  EXPECT_TRUE(std::isnan(y[0]));
+  EXPECT_EQ(0, y[1]);
+  EXPECT_EQ(inf, y[4]);
+  EXPECT_TRUE(std::isnan(y[5]));
+  EXPECT_FLOAT_EQ(0.1f, y[8]);
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -0,0 +1,126 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/memory_tracker.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class MemoryTrackerTest : public ::testing::Test {
+ protected:
+  MemoryTracker::Account* account(const string& owner,
+      MemoryTracker::Kind kind) {
+    return MemoryTracker::Get()->account(owner, kind);
+  }
+};
+
+TEST_F(MemoryTrackerTest, TestScopes) {
+  MemoryTracker* tracker = MemoryTracker::Get();
+  MemoryTracker::Account* data = account("scopes", MemoryTracker::DATA);
+  MemoryTracker::Account* params = account("scopes", MemoryTracker::PARAMS);
+  const size_t live_bytes = tracker->live_bytes();
+  {
+    MemoryTracker::Scope scope("scopes", MemoryTracker::DATA);
+    {
+      MemoryTracker::Scope inner(params);
+      EXPECT_EQ(params, tracker->current());
+    }
+    EXPECT_EQ(data, tracker->current());
+    SyncedMemory mem(100);
+    EXPECT_EQ(0, data->live_bytes);
+    mem.cpu_data();
+    EXPECT_EQ(100, data->live_bytes);
+    EXPECT_EQ(1, data->allocations);
+    EXPECT_EQ(live_bytes + 100, tracker->live_bytes());
+    mem.set_account(params);
+    EXPECT_EQ(0, data->live_bytes);
+    EXPECT_EQ(100, params->live_bytes);
+    EXPECT_EQ(live_bytes + 100, tracker->live_bytes());
+  }
+  EXPECT_NE(data, tracker->current());
+  EXPECT_EQ(0, params->live_bytes);
+  EXPECT_EQ(100, params->peak_bytes);
+  EXPECT_EQ(live_bytes, tracker->live_bytes());
+  EXPECT_GE(tracker->peak_bytes(), live_bytes + 100);
+  tracker->ResetPeaks();
+  EXPECT_EQ(0, params->peak_bytes);
+  EXPECT_EQ(tracker->live_bytes(), tracker->peak_bytes());
+}
+
+TEST_F(MemoryTrackerTest, TestBlob) {
+  MemoryTracker::Scope scope("blob", MemoryTracker::DATA);
+  Blob<float> blob(2, 3, 4, 5);
+  blob.mutable_cpu_data();
+  blob.mutable_cpu_diff();
+  // The data account also holds the shape of the blob.
+  EXPECT_GE(account("blob", MemoryTracker::DATA)->live_bytes,
+            blob.count() * sizeof(float));
+  EXPECT_EQ(blob.count() * sizeof(float),
+            account("blob", MemoryTracker::DIFF)->live_bytes);
+  // Growing outside the scope stays charged to the blob's accounts.
+  {
+    MemoryTracker::Scope other("other", MemoryTracker::OTHER);
+    blob.Reshape(4, 3, 4, 5);
+    blob.mutable_cpu_data();
+  }
+  EXPECT_GE(account("blob", MemoryTracker::DATA)->live_bytes,
+            blob.count() * sizeof(float));
+  EXPECT_EQ(0, account("other", MemoryTracker::OTHER)->live_bytes);
+}
+
+TEST_F(MemoryTrackerTest, TestNet) {
+  const string proto =
+      "name: 'TrackedNet' "
+      "layer { "
+      "  name: 'tracked_data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 dim: 8 dim: 8 } "
+      "    data_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'tracked_conv' "
+      "  type: 'Convolution' "
+      "  convolution_param { "
+      "    num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  loss_weight: 1 "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  {
+    Net<float> net(param);
+    net.Forward();
+    net.Backward();
+    // The weights and bias with their gradients, the output and its
+    // gradient, and one image unrolled for the GEMM. The data accounts also
+    // hold the small buffers of the layers, such as the blob shapes.
+    EXPECT_EQ((4 * 3 * 3 * 3 + 4) * 2 * sizeof(float),
+              account("tracked_conv", MemoryTracker::PARAMS)->live_bytes);
+    EXPECT_GE(account("tracked_conv", MemoryTracker::DATA)->live_bytes,
+              2 * 4 * 6 * 6 * sizeof(float));
+    EXPECT_EQ(2 * 4 * 6 * 6 * sizeof(float),
+              account("tracked_conv", MemoryTracker::DIFF)->live_bytes);
+    EXPECT_GE(account("tracked_conv", MemoryTracker::COL_BUFFER)->live_bytes,
+              3 * 3 * 3 * 6 * 6 * sizeof(float));
+    EXPECT_GE(account("tracked_data", MemoryTracker::DATA)->live_bytes,
+              2 * 3 * 8 * 8 * sizeof(float));
+  }
+  EXPECT_EQ(0, account("tracked_conv", MemoryTracker::PARAMS)->live_bytes);
+  EXPECT_EQ(0, account("tracked_conv", MemoryTracker::DATA)->live_bytes);
+}
+
+}  // namespace caffe
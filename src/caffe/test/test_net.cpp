@@ -1,3 +1,4 @@
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -629,6 +630,461 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitRecomputeNet(const bool recompute,
+      const string& checkpoints = "") {
+    ostringstream proto;
+    proto << "name: 'RecomputeNetwork' state { phase: TRAIN } ";
+    if (recompute) {
+      proto << "recompute: true " << checkpoints;
+    }
+    proto <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'target' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 10 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv2' "
+        "  top: 'pool1' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'pool1' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip1' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sigmoid' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip2' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  // Checks that training in recompute mode matches the normal forward and
+  // backward passes exactly, and that dropped_blob is actually dropped.
+  virtual void TestRecomputeMatches(const string& checkpoints,
+      const string& dropped_blob) {
+    const int kNumIters = 2;
+    Caffe::set_random_seed(seed_);
+    InitRecomputeNet(false);
+    vector<Dtype> expected_losses;
+    for (int i = 0; i < kNumIters; ++i) {
+      expected_losses.push_back(net_->ForwardBackward());
+    }
+    vector<shared_ptr<Blob<Dtype> > > expected_params;
+    vector<shared_ptr<Blob<Dtype> > > expected_param_diffs;
+    CopyNetParams(false, &expected_params);
+    CopyNetParams(true, &expected_param_diffs);
+
+    Caffe::set_random_seed(seed_);
+    InitRecomputeNet(true, checkpoints);
+    for (int i = 0; i < kNumIters; ++i) {
+      Dtype loss;
+      net_->Forward(&loss);
+      EXPECT_EQ(expected_losses[i], loss);
+      EXPECT_EQ(SyncedMemory::UNINITIALIZED,
+          net_->blob_by_name(dropped_blob)->data()->head());
+      net_->Backward();
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+    ASSERT_EQ(expected_params.size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+        EXPECT_EQ(expected_param_diffs[i]->cpu_diff()[j],
+                  params[i]->cpu_diff()[j]);
+      }
+    }
+  }
+
+  virtual void InitMemoryReuseNet(const bool reuse_buffers) {
+    ostringstream proto;
+    proto << "name: 'MemoryReuseNetwork' state { phase: TRAIN } "
+          << "reuse_buffers: " << (reuse_buffers ? "true " : "false ") <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 4 dim: 4 } "
+        "    shape { dim: 2 dim: 10 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'flatten' "
+        "  type: 'Flatten' "
+        "  bottom: 'data' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip2' "
+        "  bottom: 'ip3' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'flatten2' "
+        "  type: 'Flatten' "
+        "  bottom: 'sum' "
+        "  top: 'sum_flat' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'sum_flat' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sigmoid' "
+        "  top: 'ip4' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip4' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitParallelNet(const int layer_threads) {
+    ostringstream proto;
+    proto << "name: 'ParallelNetwork' state { phase: TRAIN } "
+          << "layer_threads: " << layer_threads << " ";
+    proto <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 5 dim: 3 dim: 4 dim: 4 } "
+        "    shape { dim: 5 dim: 10 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} ";
+    const char* towers[] = {"a", "b", "c"};
+    const char* activations[] = {"ReLU", "Dropout", "Sigmoid"};
+    for (int i = 0; i < 3; ++i) {
+      proto <<
+          "layer { "
+          "  name: 'ip_" << towers[i] << "' "
+          "  type: 'InnerProduct' "
+          "  bottom: 'data' "
+          "  top: 'ip_" << towers[i] << "' "
+          "  inner_product_param { "
+          "    num_output: 10 "
+          "    weight_filler { type: 'gaussian' std: 0.1 } "
+          "    bias_filler { type: 'gaussian' std: 0.1 } "
+          "  } "
+          "} "
+          "layer { "
+          "  name: 'act_" << towers[i] << "' "
+          "  type: '" << activations[i] << "' "
+          "  bottom: 'ip_" << towers[i] << "' "
+          "  top: 'ip_" << towers[i] << "' "
+          "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'ip_a' "
+        "  bottom: 'ip_b' "
+        "  bottom: 'ip_c' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'ip_out' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'concat' "
+        "  top: 'ip_out' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip_out' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} "
+        "layer { "
+        "  name: 'loss_a' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip_a' "
+        "  bottom: 'target' "
+        "  top: 'loss_a' "
+        "  loss_weight: 0.5 "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitConcatSliceNet(const bool zero_copy_concat,
+      shared_ptr<Net<Dtype> >* net) {
+    ostringstream proto;
+    proto << "name: 'ConcatSliceNetwork' state { phase: TRAIN } "
+          << "zero_copy_concat: " << (zero_copy_concat ? "true " : "false ") <<
+        "force_backward: true "
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  input_param { "
+        "    shape { dim: 1 dim: 3 dim: 4 dim: 4 } "
+        "    shape { dim: 1 dim: 10 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'ip_a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip_a' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip_a' "
+        "  top: 'ip_a' "
+        "} "
+        "layer { "
+        "  name: 'ip_b' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip_b' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'ip_a' "
+        "  bottom: 'ip_b' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'concat' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  bottom: 'sigmoid' "
+        "  top: 'slice_a' "
+        "  top: 'slice_b' "
+        "  slice_param { slice_point: 3 } "
+        "} "
+        "layer { "
+        "  name: 'target_slice' "
+        "  type: 'Slice' "
+        "  bottom: 'target' "
+        "  top: 'target_a' "
+        "  top: 'target_b' "
+        "  slice_param { slice_point: 3 } "
+        "} "
+        "layer { "
+        "  name: 'loss_a' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'slice_a' "
+        "  bottom: 'target_a' "
+        "  top: 'loss_a' "
+        "} "
+        "layer { "
+        "  name: 'loss_b' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'slice_b' "
+        "  bottom: 'target_b' "
+        "  top: 'loss_b' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    net->reset(new Net<Dtype>(param));
+  }
+
+  virtual void InitPlanCacheNet(const size_t plan_cache_bytes,
+      shared_ptr<Net<Dtype> >* net) {
+    ostringstream proto;
+    proto << "name: 'PlanCacheNetwork' "
+          << "plan_cache_bytes: " << plan_cache_bytes << " " <<
+        "layer { "
+        "  name: 'input' "
+        "  type: 'Input' "
+        "  input_param { shape { dim: 1 dim: 3 dim: 6 dim: 6 } } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'pool' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv' "
+        "  top: 'pool' "
+        "  pooling_param { pool: MAX global_pooling: true } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'pool' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    net->reset(new Net<Dtype>(param));
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1342,6 +1798,65 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestToBinaryProto) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  string filename;
+  MakeTempFilename(&filename);
+  const bool kWriteDiff = true;
+  this->net_->ToBinaryProto(filename, kWriteDiff);
+
+  // The streamed file parses to the same NetParameter as ToProto.
+  NetParameter expected_param;
+  this->net_->ToProto(&expected_param, kWriteDiff);
+  NetParameter actual_param;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &actual_param));
+  EXPECT_EQ(expected_param.SerializeAsString(),
+      actual_param.SerializeAsString());
+
+  // And streams back into a freshly initialized net.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFromBinaryProto(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(expected_param.layer(1).blobs_size(), 1);
+  const BlobProto& expected_blob = expected_param.layer(1).blobs(0);
+  Blob<Dtype> expected_params;
+  expected_params.FromProto(expected_blob);
+  for (int i = 0; i < params[0]->count(); ++i) {
+    EXPECT_EQ(expected_params.cpu_data()[i], params[0]->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromBinaryProto) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  Blob<Dtype> expected_params;
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  Blob<Dtype>* ip1_weights =
+      this->net_->layer_by_name("innerproduct1")->blobs()[0].get();
+  expected_params.CopyFrom(*ip1_weights, kCopyDiff, kReshape);
+
+  // Weights saved by protobuf itself are streamed in too.
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(net_param, filename);
+
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  ip1_weights = this->net_->layer_by_name("innerproduct1")->blobs()[0].get();
+  this->net_->CopyTrainedLayersFrom(filename);
+  for (int i = 0; i < expected_params.count(); ++i) {
+    EXPECT_EQ(expected_params.cpu_data()[i], ip1_weights->cpu_data()[i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2541,6 +3056,208 @@ TYPED_TEST(NetTest, TestForcePropagateDown) {
   }
 }
 
+TYPED_TEST(NetTest, TestRecompute) {
+  this->TestRecomputeMatches("", "conv2");
+}
+
+TYPED_TEST(NetTest, TestRecomputeCheckpoints) {
+  this->TestRecomputeMatches(
+      "recompute_checkpoint: 'relu1' recompute_checkpoint: 'sigmoid' ", "ip1");
+}
+
+TYPED_TEST(NetTest, TestReuseBuffers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumIters = 3;
+  Caffe::set_random_seed(this->seed_);
+  this->InitMemoryReuseNet(false);
+  vector<Dtype> expected_losses;
+  for (int i = 0; i < kNumIters; ++i) {
+    expected_losses.push_back(this->net_->ForwardBackward());
+  }
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  vector<shared_ptr<Blob<Dtype> > > expected_param_diffs;
+  this->CopyNetParams(false, &expected_params);
+  this->CopyNetParams(true, &expected_param_diffs);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitMemoryReuseNet(true);
+  for (int i = 0; i < kNumIters; ++i) {
+    EXPECT_EQ(expected_losses[i], this->net_->ForwardBackward());
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+      EXPECT_EQ(expected_param_diffs[i]->cpu_diff()[j],
+                params[i]->cpu_diff()[j]);
+    }
+  }
+  // Some diffs were given buffers of other blobs.
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  set<SyncedMemory*> memory;
+  int num_buffers = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    memory.insert(blobs[i]->data().get());
+    memory.insert(blobs[i]->diff().get());
+    num_buffers += 2;
+  }
+  // Splits and flattens share data and diffs between 5 pairs of blobs.
+  EXPECT_LT(memory.size(), num_buffers - 5);
+}
+
+TYPED_TEST(NetTest, TestParallelLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumIters = 3;
+  Caffe::set_random_seed(this->seed_);
+  this->InitParallelNet(0);
+  vector<Dtype> expected_losses;
+  for (int i = 0; i < kNumIters; ++i) {
+    expected_losses.push_back(this->net_->ForwardBackward());
+  }
+  vector<shared_ptr<Blob<Dtype> > > expected_blobs;
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    expected_blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected_blobs[i]->CopyFrom(*this->net_->blobs()[i], false, true);
+    expected_blobs[i]->CopyFrom(*this->net_->blobs()[i], true, false);
+  }
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  vector<shared_ptr<Blob<Dtype> > > expected_param_diffs;
+  this->CopyNetParams(false, &expected_params);
+  this->CopyNetParams(true, &expected_param_diffs);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitParallelNet(3);
+  for (int i = 0; i < kNumIters; ++i) {
+    EXPECT_EQ(expected_losses[i], this->net_->ForwardBackward());
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = this->net_->blobs();
+  ASSERT_EQ(expected_blobs.size(), blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    for (int j = 0; j < blobs[i]->count(); ++j) {
+      EXPECT_EQ(expected_blobs[i]->cpu_data()[j], blobs[i]->cpu_data()[j]);
+      EXPECT_EQ(expected_blobs[i]->cpu_diff()[j], blobs[i]->cpu_diff()[j]);
+    }
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(expected_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+      EXPECT_EQ(expected_param_diffs[i]->cpu_diff()[j],
+                params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcat) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Net<Dtype> > net, zero_copy_net;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatSliceNet(false, &net);
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatSliceNet(true, &zero_copy_net);
+  const shared_ptr<Blob<Dtype> > concat = zero_copy_net->blob_by_name("concat");
+  EXPECT_EQ(concat->data(), zero_copy_net->blob_by_name("ip_a")->data());
+  EXPECT_EQ(concat->diff(), zero_copy_net->blob_by_name("ip_b")->diff());
+  EXPECT_EQ(6, zero_copy_net->blob_by_name("ip_b")->data_offset());
+  EXPECT_EQ(zero_copy_net->blob_by_name("sigmoid")->data(),
+            zero_copy_net->blob_by_name("slice_b")->data());
+  EXPECT_EQ(zero_copy_net->blob_by_name("target")->data(),
+            zero_copy_net->blob_by_name("target_a")->data());
+  // Batch size 2 makes the slices of the concat axis not contiguous, and the
+  // views are dropped; going back to 1 restores them.
+  const int kBatchSizes[] = {1, 2, 1};
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int b = 0; b < 3; ++b) {
+    for (int n = 0; n < 2; ++n) {
+      Net<Dtype>* current_net = n == 0 ? net.get() : zero_copy_net.get();
+      for (int i = 0; i < 2; ++i) {
+        Blob<Dtype>* input = current_net->input_blobs()[i];
+        vector<int> shape = input->shape();
+        shape[0] = kBatchSizes[b];
+        input->Reshape(shape);
+        Caffe::set_random_seed(this->seed_ + b);
+        filler.Fill(input);
+      }
+      current_net->Reshape();
+    }
+    EXPECT_EQ(kBatchSizes[b] == 1,
+        concat->data() == zero_copy_net->blob_by_name("ip_b")->data());
+    EXPECT_EQ(net->ForwardBackward(), zero_copy_net->ForwardBackward());
+    for (int i = 0; i < net->blobs().size(); ++i) {
+      const Blob<Dtype>& expected = *net->blobs()[i];
+      const Blob<Dtype>& actual = *zero_copy_net->blobs()[i];
+      ASSERT_EQ(expected.count(), actual.count());
+      // relu_a backpropagates in place into its slice of the concat diff.
+      const bool check_diff = net->blob_names()[i] != "concat";
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j]);
+        if (check_diff) {
+          EXPECT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]);
+        }
+      }
+    }
+    for (int i = 0; i < net->params().size(); ++i) {
+      const Blob<Dtype>& expected = *net->params()[i];
+      const Blob<Dtype>& actual = *zero_copy_net->params()[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestPlanCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Net<Dtype> > net;
+  shared_ptr<Net<Dtype> > cached_net;
+  shared_ptr<Net<Dtype> > small_cache_net;
+  Caffe::set_random_seed(this->seed_);
+  this->InitPlanCacheNet(0, &net);
+  Caffe::set_random_seed(this->seed_);
+  this->InitPlanCacheNet(1 << 20, &cached_net);
+  Caffe::set_random_seed(this->seed_);
+  this->InitPlanCacheNet(1, &small_cache_net);
+  Net<Dtype>* nets[] = {net.get(), cached_net.get(), small_cache_net.get()};
+  // The spatial size changes the shapes of every layer; the batch size those
+  // of the blobs only.
+  const int kShapes[][2] = {{1, 6}, {2, 6}, {1, 8}, {1, 6}, {2, 6}, {1, 8}};
+  const int kNumShapes = sizeof(kShapes) / sizeof(kShapes[0]);
+  vector<Blob<Dtype>*> first_prob(3, static_cast<Blob<Dtype>*>(NULL));
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int s = 0; s < kNumShapes; ++s) {
+    for (int n = 0; n < 3; ++n) {
+      Blob<Dtype>* input = nets[n]->input_blobs()[0];
+      vector<int> shape = input->shape();
+      shape[0] = kShapes[s][0];
+      shape[2] = shape[3] = kShapes[s][1];
+      input->Reshape(shape);
+      Caffe::set_random_seed(this->seed_ + s);
+      filler.Fill(input);
+      // Plans are switched by Reshape, or by Forward if it is not called.
+      if (s % 2 == 0) { nets[n]->Reshape(); }
+      nets[n]->Forward();
+    }
+    // Going back to a cached shape reuses its blobs.
+    if (s < 3) {
+      first_prob[s] = cached_net->blob_by_name("prob").get();
+    } else {
+      EXPECT_EQ(first_prob[s - 3], cached_net->blob_by_name("prob").get());
+    }
+    const Blob<Dtype>& expected = *net->blob_by_name("prob");
+    for (int n = 1; n < 3; ++n) {
+      const Blob<Dtype>& actual = *nets[n]->blob_by_name("prob");
+      ASSERT_TRUE(expected.shape() == actual.shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j]);
+      }
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestAllInOneNetTrain) {
   vector<string> stages;
   stages.push_back("train");
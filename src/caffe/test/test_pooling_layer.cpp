@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -609,6 +610,85 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside training, max pooling runs without the mask; compare it with
+  // the masked pooling of top[1], forward and backward.
+  this->blob_bottom_->Reshape(2, 3, 13, 17);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const int kernels[] = {2, 3, 3, 4, 0};
+  const int strides[] = {2, 2, 1, 3, 1};
+  const int pads[] = {0, 1, 1, 2, 0};
+  for (int i = 0; i < 5; ++i) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    if (kernels[i]) {
+      pooling_param->set_kernel_size(kernels[i]);
+      pooling_param->set_stride(strides[i]);
+      pooling_param->set_pad(pads[i]);
+    } else {
+      pooling_param->set_global_pooling(true);
+    }
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    Blob<Dtype> masked_top;
+    vector<Blob<Dtype>*> masked_top_vec;
+    masked_top_vec.push_back(&masked_top);
+    masked_top_vec.push_back(this->blob_top_mask_);
+    PoolingLayer<Dtype> masked_layer(layer_param);
+    masked_layer.SetUp(this->blob_bottom_vec_, masked_top_vec);
+    masked_layer.Forward(this->blob_bottom_vec_, masked_top_vec);
+    filler.Fill(&masked_top);
+    caffe_copy(masked_top.count(), masked_top.cpu_data(),
+        masked_top.mutable_cpu_diff());
+    masked_layer.Forward(this->blob_bottom_vec_, masked_top_vec);
+    vector<bool> propagate_down(1, true);
+    masked_layer.Backward(masked_top_vec, propagate_down,
+        this->blob_bottom_vec_);
+    const vector<Dtype> expected_diff(this->blob_bottom_->cpu_diff(),
+        this->blob_bottom_->cpu_diff() + this->blob_bottom_->count());
+    layer_param.set_phase(TEST);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(masked_top.count(), this->blob_top_->count());
+    for (int j = 0; j < masked_top.count(); ++j) {
+      EXPECT_EQ(masked_top.cpu_data()[j], this->blob_top_->cpu_data()[j]);
+    }
+    caffe_copy(masked_top.count(), masked_top.cpu_diff(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    for (int j = 0; j < this->blob_bottom_->count(); ++j) {
+      EXPECT_EQ(expected_diff[j], this->blob_bottom_->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardAveGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_global_pooling(true);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  this->blob_bottom_->Reshape(2, 3, 13, 17);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  PoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int spatial_dim = this->blob_bottom_->count(2);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    Dtype sum = 0;
+    for (int j = 0; j < spatial_dim; ++j) {
+      sum += this->blob_bottom_->cpu_data()[i * spatial_dim + j];
+    }
+    EXPECT_NEAR(sum / spatial_dim, this->blob_top_->cpu_data()[i], 1e-5);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/perf_counters.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ProfilerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ProfilerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    Profiler::Get()->Clear();
+    Profiler::Get()->set_peak(0, 0);
+  }
+  virtual ~ProfilerTest() {
+    Profiler::set_enabled(false);
+    Profiler::set_counters_enabled(false);
+    Profiler::Get()->Clear();
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProfilerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ProfilerTest, TestPercentile) {
+  vector<float> values;
+  for (int i = 100; i > 0; --i) {
+    values.push_back(i);
+  }
+  EXPECT_EQ(50, Profiler::Percentile(values, 50));
+  EXPECT_EQ(99, Profiler::Percentile(values, 99));
+  EXPECT_EQ(100, Profiler::Percentile(values, 100));
+  EXPECT_EQ(1, Profiler::Percentile(values, 0));
+}
+
+TYPED_TEST(ProfilerTest, TestRecordLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_name("ip");
+  layer_param.mutable_inner_product_param()->set_num_output(10);
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<bool> propagate_down(1, true);
+  // Nothing is recorded while disabled.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(0, Profiler::Get()->profiles().size());
+  Profiler::set_enabled(true);
+  for (int i = 0; i < 3; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Profiler::set_enabled(false);
+  const vector<Profiler::LayerProfile> profiles = Profiler::Get()->profiles();
+  ASSERT_EQ(1, profiles.size());
+  const Profiler::LayerProfile& profile = profiles[0];
+  EXPECT_EQ("ip", profile.name);
+  EXPECT_EQ("InnerProduct", profile.type);
+  EXPECT_EQ(this->blob_bottom_->shape_string(), profile.shape);
+  EXPECT_EQ(3, profile.forward.microseconds.size());
+  EXPECT_EQ(1, profile.backward.microseconds.size());
+  // M = 2, K = 60, N = 10.
+  EXPECT_EQ(3 * 2.0 * 2 * 60 * 10, profile.forward.flops);
+  EXPECT_EQ(4.0 * 2 * 60 * 10, profile.backward.flops);
+  EXPECT_EQ(3 * (120 + 20 + 600 + 10) * sizeof(Dtype),
+            profile.forward.bytes);
+  EXPECT_EQ(20 * sizeof(Dtype), profile.top_bytes);
+  EXPECT_EQ((600 + 10) * sizeof(Dtype), profile.param_bytes);
+}
+
+TYPED_TEST(ProfilerTest, TestWriteReport) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_name("relu");
+  ReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Profiler::set_enabled(true);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Profiler::set_enabled(false);
+  // One FLOP for every 2 elements moved is bandwidth-bound on any host.
+  Profiler::Get()->set_peak(100, 10);
+  std::ostringstream csv;
+  Profiler::Get()->WriteCSV(&csv);
+  std::istringstream lines(csv.str());
+  string header, row, end;
+  ASSERT_TRUE(std::getline(lines, header).good());
+  ASSERT_TRUE(std::getline(lines, row).good());
+  EXPECT_FALSE(std::getline(lines, end).good());
+  EXPECT_EQ(0, header.find("name,type,shape,direction,calls,"));
+  EXPECT_EQ(0, row.find("relu,ReLU," + this->blob_bottom_->shape_string() +
+                        ",forward,1,"));
+  EXPECT_NE(string::npos, row.find(",memory,"));
+  std::ostringstream json;
+  Profiler::Get()->WriteJSON(&json);
+  EXPECT_NE(string::npos, json.str().find("\"name\": \"relu\""));
+  EXPECT_NE(string::npos, json.str().find("\"bound\": \"memory\""));
+  EXPECT_NE(string::npos, json.str().find("\"backward\": {\"calls\": 0"));
+}
+
+TYPED_TEST(ProfilerTest, TestPerfCounters) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_name("relu");
+  ReLULayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Profiler::set_counters_enabled(true);
+  Profiler::set_enabled(true);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Profiler::set_enabled(false);
+  const vector<Profiler::LayerProfile> profiles = Profiler::Get()->profiles();
+  ASSERT_EQ(1, profiles.size());
+  const vector<double>& counters = profiles[0].forward.counters;
+  ASSERT_EQ(PerfCounters::NUM_COUNTERS, counters.size());
+  const PerfCounters* perf_counters = PerfCounters::ForThread();
+  for (int i = 0; i < PerfCounters::NUM_COUNTERS; ++i) {
+    if (perf_counters->available(i)) {
+      EXPECT_GE(counters[i], 0) << PerfCounters::name(i);
+    } else {
+      EXPECT_EQ(-1, counters[i]) << PerfCounters::name(i);
+    }
+  }
+  // Unavailable counters are left blank in the CSV.
+  std::ostringstream csv;
+  Profiler::Get()->WriteCSV(&csv);
+  std::istringstream lines(csv.str());
+  string header, row;
+  ASSERT_TRUE(std::getline(lines, header).good());
+  ASSERT_TRUE(std::getline(lines, row).good());
+  EXPECT_EQ(std::count(header.begin(), header.end(), ','),
+            std::count(row.begin(), row.end(), ','));
+}
+
+}  // namespace caffe
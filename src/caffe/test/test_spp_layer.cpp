@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -10,6 +11,7 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -130,5 +132,83 @@ TYPED_TEST(SPPLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SPPLayerTest, TestGradientAve) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SPPParameter* spp_param = layer_param.mutable_spp_param();
+  spp_param->set_pyramid_height(3);
+  spp_param->set_pool(SPPParameter_PoolMethod_AVE);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(SPPLayerTest, TestForwardLevels) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_spp_param()->set_pyramid_height(2);
+  SPPLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Each image holds the 1x1 level of all channels, then the 2x2 one.
+  const int num = this->blob_bottom_->num();
+  const int channels = this->blob_bottom_->channels();
+  const int spatial_dim = this->blob_bottom_->count(2);
+  ASSERT_EQ(num * channels * 5, this->blob_top_->count());
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* plane = this->blob_bottom_->cpu_data() +
+          this->blob_bottom_->offset(n, c);
+      Dtype expected = plane[0];
+      for (int i = 1; i < spatial_dim; ++i) {
+        expected = std::max(expected, plane[i]);
+      }
+      const Dtype* top = this->blob_top_->cpu_data() + n * channels * 5;
+      EXPECT_EQ(expected, top[c]);
+      EXPECT_EQ(expected, std::max(
+          std::max(top[channels + c * 4], top[channels + c * 4 + 1]),
+          std::max(top[channels + c * 4 + 2], top[channels + c * 4 + 3])));
+    }
+  }
+}
+
+TYPED_TEST(SPPLayerTest, TestForwardBackwardTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside training the argmax is only found if Backward runs.
+  LayerParameter layer_param;
+  layer_param.mutable_spp_param()->set_pyramid_height(3);
+  SPPLayer<Dtype> train_layer(layer_param);
+  train_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  train_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> top_diff(this->blob_top_->shape());
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  train_layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  const vector<Dtype> expected_top(this->blob_top_->cpu_data(),
+      this->blob_top_->cpu_data() + this->blob_top_->count());
+  const vector<Dtype> expected_diff(this->blob_bottom_->cpu_diff(),
+      this->blob_bottom_->cpu_diff() + this->blob_bottom_->count());
+  layer_param.set_phase(TEST);
+  SPPLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  for (int i = 0; i < expected_top.size(); ++i) {
+    EXPECT_EQ(expected_top[i], this->blob_top_->cpu_data()[i]);
+  }
+  for (int i = 0; i < expected_diff.size(); ++i) {
+    EXPECT_EQ(expected_diff[i], this->blob_bottom_->cpu_diff()[i]);
+  }
+}
 
 }  // namespace caffe
@@ -0,0 +1,72 @@
+#include <boost/thread.hpp>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TraceTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Tracer::Stop();
+  }
+
+  string WriteTrace() {
+    string filename;
+    MakeTempFilename(&filename);
+    Tracer::Write(filename);
+    std::ifstream in(filename.c_str());
+    std::stringstream contents;
+    contents << in.rdbuf();
+    remove(filename.c_str());
+    return contents.str();
+  }
+
+  static void Worker() {
+    Tracer::SetThreadName("Worker \"1\"");
+    TraceSpan trace("Work", "test");
+  }
+};
+
+TEST_F(TraceTest, TestDisabled) {
+  Tracer::Start();
+  Tracer::Stop();
+  {
+    TraceSpan trace("Ignored", "test");
+  }
+  EXPECT_EQ(string::npos, WriteTrace().find("Ignored"));
+}
+
+TEST_F(TraceTest, TestSpansOnThreads) {
+  Tracer::Start();
+  {
+    TraceSpan outer("Outer", "test");
+    TraceSpan inner(string("Inner"), "test");
+  }
+  boost::thread thread(&TraceTest::Worker);
+  thread.join();
+  Tracer::Stop();
+  const string trace = WriteTrace();
+  EXPECT_EQ(0, trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["));
+  EXPECT_NE(string::npos, trace.find("{\"name\": \"Outer\", \"cat\": \"test\", "
+                                     "\"ph\": \"X\", \"ts\": "));
+  EXPECT_NE(string::npos, trace.find("{\"name\": \"Inner\""));
+  // The worker's events are kept after it exits.
+  EXPECT_NE(string::npos, trace.find("{\"name\": \"Work\""));
+  EXPECT_NE(string::npos, trace.find("\"args\": {\"name\": "
+                                     "\"Worker \\\"1\\\"\"}"));
+  // Starting again drops the events of the previous trace.
+  Tracer::Start();
+  Tracer::Stop();
+  EXPECT_EQ(string::npos, WriteTrace().find("Outer"));
+}
+
+}  // namespace caffe
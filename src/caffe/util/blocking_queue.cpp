@@ -5,6 +5,8 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
@@ -49,6 +51,8 @@ T BlockingQueue<T>::pop(const string& log_on_wait) {
     if (!log_on_wait.empty()) {
       LOG_EVERY_N(INFO, 1000)<< log_on_wait;
     }
+    TraceSpan trace(log_on_wait.empty() ? "Queue wait" : log_on_wait.c_str(),
+        "wait");
     sync_->condition_.wait(lock);
   }
 
@@ -74,6 +78,7 @@ T BlockingQueue<T>::peek() {
   boost::mutex::scoped_lock lock(sync_->mutex_);
 
   while (queue_.empty()) {
+    TraceSpan trace("Queue wait", "wait");
     sync_->condition_.wait(lock);
   }
 
@@ -92,5 +97,6 @@ template class BlockingQueue<Datum*>;
 template class BlockingQueue<shared_ptr<DataReader::QueuePair> >;
 template class BlockingQueue<P2PSync<float>*>;
 template class BlockingQueue<P2PSync<double>*>;
+template class BlockingQueue<shared_ptr<SnapshotWriter::Task> >;
 
 }  // namespace caffe
@@ -0,0 +1,132 @@
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <cstdlib>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "caffe/util/conv_algorithm_cache.hpp"
+
+namespace caffe {
+
+class ConvAlgorithmCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+ConvAlgorithmCache::ConvAlgorithmCache() : sync_(new sync()) {}
+
+ConvAlgorithmCache* ConvAlgorithmCache::Get() {
+  // Leaked on purpose, as layers may still be destroyed at exit.
+  static ConvAlgorithmCache* cache = NULL;
+  static boost::mutex mutex;
+  boost::mutex::scoped_lock lock(mutex);
+  if (!cache) {
+    cache = new ConvAlgorithmCache();
+    const char* home = getenv("HOME");
+    if (home && *home) {
+      cache->set_path(string(home) + "/.caffe/conv_algorithms.tsv");
+    }
+  }
+  return cache;
+}
+
+string ConvAlgorithmCache::HostKey() {
+  string model = "unknown";
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      const size_t colon = line.find(':');
+      if (colon != string::npos) {
+        model = line.substr(line.find_first_not_of(' ', colon + 1));
+      }
+      break;
+    }
+  }
+  // The BLAS libraries take their thread counts from these.
+  int threads = boost::thread::hardware_concurrency();
+  const char* variables[] = {"OPENBLAS_NUM_THREADS", "MKL_NUM_THREADS",
+                             "OMP_NUM_THREADS"};
+  for (int i = 0; i < 3; ++i) {
+    const char* value = getenv(variables[i]);
+    if (value && atoi(value) > 0) {
+      threads = atoi(value);
+      break;
+    }
+  }
+  std::ostringstream key;
+  key << model << " x" << threads;
+  return key.str();
+}
+
+void ConvAlgorithmCache::set_path(const string& path) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  path_ = path;
+  choices_.clear();
+  if (path_.empty()) {
+    return;
+  }
+  // One choice per line: key, algorithm, gemm_batch and microseconds
+  // separated by tabs. Later lines override earlier ones.
+  std::ifstream file(path_.c_str());
+  string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    string key;
+    Choice choice;
+    if (std::getline(fields, key, '\t') &&
+        fields >> choice.algorithm >> choice.gemm_batch
+               >> choice.microseconds) {
+      choices_[key] = choice;
+    } else if (!line.empty()) {
+      LOG(WARNING) << "Ignoring malformed line in " << path_ << ": " << line;
+    }
+  }
+}
+
+string ConvAlgorithmCache::path() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return path_;
+}
+
+bool ConvAlgorithmCache::Lookup(const string& key, Choice* choice) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::map<string, Choice>::const_iterator it = choices_.find(key);
+  if (it == choices_.end()) {
+    return false;
+  }
+  *choice = it->second;
+  return true;
+}
+
+void ConvAlgorithmCache::Insert(const string& key, const Choice& choice) {
+  CHECK_EQ(key.find_first_of("\t\n"), string::npos)
+      << "Cache keys cannot contain tabs or newlines";
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  choices_[key] = choice;
+  if (path_.empty()) {
+    return;
+  }
+  const boost::filesystem::path parent =
+      boost::filesystem::path(path_).parent_path();
+  boost::system::error_code error;
+  if (!parent.empty()) {
+    boost::filesystem::create_directories(parent, error);
+  }
+  std::ofstream file(path_.c_str(), std::ios::app);
+  file << key << '\t' << choice.algorithm << '\t' << choice.gemm_batch
+       << '\t' << choice.microseconds << '\n';
+  if (!file) {
+    LOG(WARNING) << "Failed to write the convolution algorithm cache "
+                 << path_;
+  }
+}
+
+int ConvAlgorithmCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return choices_.size();
+}
+
+}  // namespace caffe
@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpu_features.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char* const kCPUISANames[] = {"generic", "sse4", "avx2", "avx512"};
+
+CPUISA InitialCPUISA() {
+  CPUISA isa = DetectCPUISA();
+  const char* name = getenv("CAFFE_CPU_ISA");
+  if (name && *name) {
+    int requested = -1;
+    for (int i = 0; i <= CPU_ISA_AVX512; ++i) {
+      if (strcmp(name, kCPUISANames[i]) == 0) { requested = i; }
+    }
+    CHECK_GE(requested, 0) << "Unknown CAFFE_CPU_ISA '" << name
+        << "', expected generic, sse4, avx2 or avx512";
+    if (requested < isa) { isa = static_cast<CPUISA>(requested); }
+  }
+  return isa;
+}
+
+CPUISA& current_cpu_isa() {
+  static CPUISA isa = InitialCPUISA();
+  return isa;
+}
+
+}  // namespace
+
+CPUISA DetectCPUISA() {
+#ifdef CAFFE_MULTI_ISA
+  // The checks for AVX and AVX-512 include the OS saving their registers.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) {
+    return CPU_ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return CPU_ISA_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return CPU_ISA_SSE4;
+  }
+#endif
+  return CPU_ISA_GENERIC;
+}
+
+CPUISA cpu_isa() {
+  return current_cpu_isa();
+}
+
+void set_cpu_isa(CPUISA isa) {
+  CHECK_LE(isa, DetectCPUISA()) << "The CPU does not support "
+      << CPUISAName(isa);
+  current_cpu_isa() = isa;
+}
+
+const char* CPUISAName(CPUISA isa) {
+  CHECK_GE(isa, CPU_ISA_GENERIC);
+  CHECK_LE(isa, CPU_ISA_AVX512);
+  return kCPUISANames[isa];
+}
+
+}  // namespace caffe
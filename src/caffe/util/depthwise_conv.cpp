@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/depthwise_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The taps of a filter row sliding along a row: output column i reads input
+// column i * stride + offset[k] through tap k, which lies inside the input
+// for i in [begin[k], end[k]). All taps lie inside it for i in
+// [interior_begin, interior_end), where the inner loops need no bounds
+// checks and vectorize.
+struct RowTaps {
+  RowTaps(const vector<int>& offsets, const int stride, const int input_size,
+      const int output_size)
+      : offset(offsets), begin(offsets.size()), end(offsets.size()),
+        interior_begin(0), interior_end(output_size) {
+    for (int k = 0; k < offsets.size(); ++k) {
+      const int o = offsets[k];
+      end[k] = o < input_size ?
+          std::min((input_size - 1 - o) / stride + 1, output_size) : 0;
+      begin[k] = std::min(o >= 0 ? 0 : (stride - 1 - o) / stride, end[k]);
+      interior_begin = std::max(interior_begin, begin[k]);
+      interior_end = std::min(interior_end, end[k]);
+    }
+    // Without an interior, the edges split at interior_begin.
+    interior_end = std::max(interior_end, interior_begin);
+  }
+  vector<int> offset;
+  vector<int> begin;
+  vector<int> end;
+  int interior_begin;
+  int interior_end;
+};
+
+// out[i] += sum_k filter[k] * in[i * stride + taps.offset[k]] over the taps
+// inside the input. kKernel and kStride fix the number of taps and the
+// stride at compile time, or are 0 to use the arguments.
+template <typename Dtype, int kKernel, int kStride>
+void correlate_row(const Dtype* in, const Dtype* filter, const RowTaps& taps,
+    const int kernel, const int stride, Dtype* out) {
+  const int K = kKernel ? kKernel : kernel;
+  const int S = kStride ? kStride : stride;
+  const int* offset = &taps.offset[0];
+  for (int i = taps.interior_begin; i < taps.interior_end; ++i) {
+    Dtype sum = out[i];
+    for (int k = 0; k < K; ++k) {
+      sum += filter[k] * in[i * S + offset[k]];
+    }
+    out[i] = sum;
+  }
+  for (int k = 0; k < K; ++k) {
+    const Dtype weight = filter[k];
+    const int left_end = std::min(taps.end[k], taps.interior_begin);
+    for (int i = taps.begin[k]; i < left_end; ++i) {
+      out[i] += weight * in[i * S + offset[k]];
+    }
+    const int right_begin = std::max(taps.begin[k], taps.interior_end);
+    for (int i = right_begin; i < taps.end[k]; ++i) {
+      out[i] += weight * in[i * S + offset[k]];
+    }
+  }
+}
+
+template <typename Dtype>
+struct CorrelateRow {
+  typedef void (*Type)(const Dtype* in, const Dtype* filter,
+      const RowTaps& taps, const int kernel, const int stride, Dtype* out);
+};
+
+// Specializes the common 3-wide filters.
+template <typename Dtype>
+typename CorrelateRow<Dtype>::Type select_correlate_row(const int kernel,
+    const int stride) {
+  if (kernel == 3 && stride == 1) { return &correlate_row<Dtype, 3, 1>; }
+  if (kernel == 3 && stride == 2) { return &correlate_row<Dtype, 3, 2>; }
+  return &correlate_row<Dtype, 0, 0>;
+}
+
+// sum_i a[i] * b[i * stride + offset] for i in [begin, end), accumulated in
+// independent lanes so that it vectorizes.
+template <typename Dtype>
+Dtype dot_row(const Dtype* a, const Dtype* b, const int stride,
+    const int offset, const int begin, const int end) {
+  const int kLanes = 8;
+  Dtype lanes[kLanes] = {0};
+  int i = begin;
+  for (; i + kLanes <= end; i += kLanes) {
+    for (int l = 0; l < kLanes; ++l) {
+      lanes[l] += a[i + l] * b[(i + l) * stride + offset];
+    }
+  }
+  Dtype sum = 0;
+  for (; i < end; ++i) {
+    sum += a[i] * b[i * stride + offset];
+  }
+  for (int l = 0; l < kLanes; ++l) {
+    sum += lanes[l];
+  }
+  return sum;
+}
+
+int output_size(const int size, const int kernel, const int pad,
+    const int stride, const int dilation) {
+  return (size + 2 * pad - (dilation * (kernel - 1) + 1)) / stride + 1;
+}
+
+vector<int> column_offsets(const int kernel_w, const int pad_w,
+    const int dilation_w) {
+  vector<int> offsets(kernel_w);
+  for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+    offsets[kernel_col] = kernel_col * dilation_w - pad_w;
+  }
+  return offsets;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weights, Dtype* data_out) {
+  const int output_h = output_size(height, kernel_h, pad_h, stride_h,
+      dilation_h);
+  const int output_w = output_size(width, kernel_w, pad_w, stride_w,
+      dilation_w);
+  const RowTaps taps(column_offsets(kernel_w, pad_w, dilation_w), stride_w,
+      width, output_w);
+  const typename CorrelateRow<Dtype>::Type correlate =
+      select_correlate_row<Dtype>(kernel_w, stride_w);
+  const int kernel_size = kernel_h * kernel_w;
+  for (int channel = 0; channel < channels; ++channel) {
+    const Dtype* im = data_im + channel * height * width;
+    for (int m = 0; m < multiplier; ++m) {
+      const Dtype* filter = weights + (channel * multiplier + m) * kernel_size;
+      for (int output_row = 0; output_row < output_h; ++output_row) {
+        Dtype* out = data_out + output_row * output_w;
+        caffe_set(output_w, Dtype(0), out);
+        for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+          const int input_row =
+              output_row * stride_h - pad_h + kernel_row * dilation_h;
+          if (input_row < 0 || input_row >= height) { continue; }
+          correlate(im + input_row * width, filter + kernel_row * kernel_w,
+              taps, kernel_w, stride_w, out);
+        }
+      }
+      data_out += output_h * output_w;
+    }
+  }
+}
+
+// Explicit instantiation
+template void depthwise_conv_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const float* weights,
+    float* data_out);
+template void depthwise_conv_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const double* weights,
+    double* data_out);
+
+template <typename Dtype>
+void depthwise_conv_backward_cpu(const Dtype* diff_out, const int channels,
+    const int height, const int width, const int multiplier,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const Dtype* weights, Dtype* diff_im) {
+  const int output_h = output_size(height, kernel_h, pad_h, stride_h,
+      dilation_h);
+  const int output_w = output_size(width, kernel_w, pad_w, stride_w,
+      dilation_w);
+  const vector<int> offsets = column_offsets(kernel_w, pad_w, dilation_w);
+  // With stride 1, input column j gathers output column j - offset[k]
+  // through tap k, a correlation like the forward pass. Otherwise the output
+  // columns are scattered through each tap.
+  vector<int> gather_offsets(kernel_w);
+  for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+    gather_offsets[kernel_col] = -offsets[kernel_col];
+  }
+  const RowTaps gather_taps(gather_offsets, 1, output_w, width);
+  const RowTaps scatter_taps(offsets, stride_w, width, output_w);
+  const typename CorrelateRow<Dtype>::Type correlate =
+      select_correlate_row<Dtype>(kernel_w, 1);
+  const int kernel_size = kernel_h * kernel_w;
+  caffe_set(channels * height * width, Dtype(0), diff_im);
+  for (int channel = 0; channel < channels; ++channel) {
+    Dtype* im = diff_im + channel * height * width;
+    for (int m = 0; m < multiplier; ++m) {
+      const Dtype* filter = weights + (channel * multiplier + m) * kernel_size;
+      for (int output_row = 0; output_row < output_h; ++output_row) {
+        const Dtype* out = diff_out + output_row * output_w;
+        for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+          const int input_row =
+              output_row * stride_h - pad_h + kernel_row * dilation_h;
+          if (input_row < 0 || input_row >= height) { continue; }
+          Dtype* in = im + input_row * width;
+          const Dtype* filter_row = filter + kernel_row * kernel_w;
+          if (stride_w == 1) {
+            correlate(out, filter_row, gather_taps, kernel_w, 1, in);
+            continue;
+          }
+          for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+            const Dtype weight = filter_row[kernel_col];
+            const int offset = scatter_taps.offset[kernel_col];
+            for (int i = scatter_taps.begin[kernel_col];
+                 i < scatter_taps.end[kernel_col]; ++i) {
+              in[i * stride_w + offset] += weight * out[i];
+            }
+          }
+        }
+      }
+      diff_out += output_h * output_w;
+    }
+  }
+}
+
+// Explicit instantiation
+template void depthwise_conv_backward_cpu<float>(const float* diff_out,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const float* weights,
+    float* diff_im);
+template void depthwise_conv_backward_cpu<double>(const double* diff_out,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const double* weights,
+    double* diff_im);
+
+template <typename Dtype>
+void depthwise_conv_weight_cpu(const Dtype* data_im, const Dtype* diff_out,
+    const int channels, const int height, const int width,
+    const int multiplier, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, Dtype* diff_weights) {
+  const int output_h = output_size(height, kernel_h, pad_h, stride_h,
+      dilation_h);
+  const int output_w = output_size(width, kernel_w, pad_w, stride_w,
+      dilation_w);
+  const RowTaps taps(column_offsets(kernel_w, pad_w, dilation_w), stride_w,
+      width, output_w);
+  const int kernel_size = kernel_h * kernel_w;
+  for (int channel = 0; channel < channels; ++channel) {
+    const Dtype* im = data_im + channel * height * width;
+    for (int m = 0; m < multiplier; ++m) {
+      Dtype* filter = diff_weights + (channel * multiplier + m) * kernel_size;
+      for (int output_row = 0; output_row < output_h; ++output_row) {
+        const Dtype* out = diff_out + output_row * output_w;
+        for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+          const int input_row =
+              output_row * stride_h - pad_h + kernel_row * dilation_h;
+          if (input_row < 0 || input_row >= height) { continue; }
+          const Dtype* in = im + input_row * width;
+          for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+            filter[kernel_row * kernel_w + kernel_col] += dot_row(out, in,
+                stride_w, taps.offset[kernel_col], taps.begin[kernel_col],
+                taps.end[kernel_col]);
+          }
+        }
+      }
+      diff_out += output_h * output_w;
+    }
+  }
+}
+
+// Explicit instantiation
+template void depthwise_conv_weight_cpu<float>(const float* data_im,
+    const float* diff_out, const int channels, const int height,
+    const int width, const int multiplier, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    float* diff_weights);
+template void depthwise_conv_weight_cpu<double>(const double* data_im,
+    const double* diff_out, const int channels, const int height,
+    const int width, const int multiplier, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    double* diff_weights);
+
+}  // namespace caffe
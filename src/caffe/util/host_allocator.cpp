@@ -0,0 +1,193 @@
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+
+namespace {
+
+struct Registry {
+  Registry() : allocator(new AlignedAllocator()) {
+    allocators.push_back(allocator);
+  }
+  boost::mutex mutex;
+  shared_ptr<HostAllocator> allocator;
+  // All allocators ever used, as their memory may still be live.
+  vector<shared_ptr<HostAllocator> > allocators;
+};
+
+Registry& registry() {
+  // Never destroyed, as memory may be freed during static destruction.
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+}  // namespace
+
+HostAllocator* HostAllocator::Get() {
+  return registry().allocator.get();
+}
+
+void HostAllocator::Set(const shared_ptr<HostAllocator>& allocator) {
+  Registry& r = registry();
+  boost::mutex::scoped_lock lock(r.mutex);
+  r.allocator = allocator ? allocator : r.allocators[0];
+  r.allocators.push_back(r.allocator);
+}
+
+class AlignedAllocator::sync {
+ public:
+  boost::mutex mutex_;
+};
+
+AlignedAllocator::AlignedAllocator(size_t alignment, HugePages huge_pages,
+    size_t huge_page_size)
+    : alignment_(alignment), huge_pages_(huge_pages),
+      huge_page_size_(huge_page_size), sync_(new sync()) {
+  CHECK_EQ(alignment & (alignment - 1), 0) << "Alignment must be a power of 2";
+  CHECK_GE(alignment, sizeof(void*));
+#ifndef __linux__
+  LOG_IF(WARNING, huge_pages != NONE) << "Huge pages are only used on Linux.";
+  huge_pages_ = NONE;
+#endif
+}
+
+void* AlignedAllocator::Allocate(size_t size) {
+  size_t alignment = alignment_;
+  size_t allocated_size = std::max<size_t>(size, 1);
+#ifdef __linux__
+  if (huge(size) && huge_pages_ == EXPLICIT) {
+    const size_t mapped_size = RoundToHugePages(size);
+    void* ptr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      mapped_[ptr] = mapped_size;
+      return ptr;
+    }
+    LOG_FIRST_N(WARNING, 1) << "No huge pages left to map " << mapped_size
+        << " bytes; check /proc/sys/vm/nr_hugepages.";
+  }
+  if (huge(size)) {
+    alignment = std::max(alignment, huge_page_size_);
+    allocated_size = RoundToHugePages(size);
+  }
+#endif
+  void* ptr = NULL;
+  if (posix_memalign(&ptr, alignment, allocated_size) != 0) {
+    ptr = NULL;
+  }
+#ifdef __linux__
+  if (ptr && huge(size) && huge_pages_ == TRANSPARENT) {
+    // Only advice; the kernel may still use small pages.
+    madvise(ptr, allocated_size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void AlignedAllocator::Free(void* ptr, size_t size) {
+#ifdef __linux__
+  if (huge(size) && huge_pages_ == EXPLICIT) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    std::map<void*, size_t>::iterator it = mapped_.find(ptr);
+    if (it != mapped_.end()) {
+      munmap(ptr, it->second);
+      mapped_.erase(it);
+      return;
+    }
+  }
+#endif
+  free(ptr);
+}
+
+class PoolingAllocator::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+PoolingAllocator::PoolingAllocator(const shared_ptr<HostAllocator>& base,
+    size_t max_cached_bytes)
+    : base_(base), max_cached_bytes_(max_cached_bytes), cached_bytes_(0),
+      hits_(0), misses_(0), sync_(new sync()) {
+  CHECK(base_);
+}
+
+PoolingAllocator::~PoolingAllocator() {
+  Trim();
+}
+
+size_t PoolingAllocator::SizeClass(size_t size) {
+  if (size <= 64) { return 64; }
+  // Round up to a quarter of the power of 2 below size.
+  size_t power = 64;
+  while (power * 2 < size) { power *= 2; }
+  const size_t step = power / 4;
+  return (size + step - 1) / step * step;
+}
+
+void* PoolingAllocator::Allocate(size_t size) {
+  const size_t size_class = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    vector<void*>& blocks = cache_[size_class];
+    if (!blocks.empty()) {
+      void* ptr = blocks.back();
+      blocks.pop_back();
+      cached_bytes_ -= size_class;
+      ++hits_;
+      return ptr;
+    }
+    ++misses_;
+  }
+  return base_->Allocate(size_class);
+}
+
+void PoolingAllocator::Free(void* ptr, size_t size) {
+  const size_t size_class = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    if (cached_bytes_ + size_class <= max_cached_bytes_) {
+      cache_[size_class].push_back(ptr);
+      cached_bytes_ += size_class;
+      return;
+    }
+  }
+  base_->Free(ptr, size_class);
+}
+
+void PoolingAllocator::Trim() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  for (std::map<size_t, vector<void*> >::iterator it = cache_.begin();
+       it != cache_.end(); ++it) {
+    for (int i = 0; i < it->second.size(); ++i) {
+      base_->Free(it->second[i], it->first);
+    }
+  }
+  cache_.clear();
+  cached_bytes_ = 0;
+}
+
+size_t PoolingAllocator::cached_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return cached_bytes_;
+}
+
+size_t PoolingAllocator::hits() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return hits_;
+}
+
+size_t PoolingAllocator::misses() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <vector>
 
+#include "caffe/util/cpu_features.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -15,43 +17,104 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
   return static_cast<unsigned>(a) < static_cast<unsigned>(b);
 }
 
+// The output columns [begin, end) whose input column, offset + column *
+// stride, lies in [0, width).
+inline void valid_columns(const int offset, const int stride, const int width,
+    const int output_w, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : std::min((stride - 1 - offset) / stride,
+      output_w);
+  *end = offset < width ?
+      std::min((width - 1 - offset) / stride + 1, output_w) : 0;
+  *end = std::max(*end, *begin);
+}
+
+// The 2D im2col and col2im of one channel. Without bounds checks in the
+// inner loops, they vectorize, and cpu_dispatch_for runs them for the
+// instruction set of the CPU.
 template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
-    const int pad_h, const int pad_w,
-    const int stride_h, const int stride_w,
-    const int dilation_h, const int dilation_w,
-    Dtype* data_col) {
-  const int output_h = (height + 2 * pad_h -
-    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
-  const int output_w = (width + 2 * pad_w -
-    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
-  const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            for (int output_cols = output_w; output_cols; output_cols--) {
-              *(data_col++) = 0;
-            }
+class Im2colChannel {
+ public:
+  Im2colChannel(const bool im2col, const int height, const int width,
+      const int kernel_h, const int kernel_w, const int pad_h,
+      const int pad_w, const int stride_h, const int stride_w,
+      const int dilation_h, const int dilation_w, const Dtype* data_in,
+      Dtype* data_out)
+      : im2col_(im2col), height_(height), width_(width), kernel_h_(kernel_h),
+        kernel_w_(kernel_w), pad_h_(pad_h), pad_w_(pad_w),
+        stride_h_(stride_h), stride_w_(stride_w), dilation_h_(dilation_h),
+        dilation_w_(dilation_w),
+        output_h_((height + 2 * pad_h - (dilation_h * (kernel_h - 1) + 1)) /
+            stride_h + 1),
+        output_w_((width + 2 * pad_w - (dilation_w * (kernel_w - 1) + 1)) /
+            stride_w + 1),
+        data_in_(data_in), data_out_(data_out) {}
+
+  void operator()(const int channel) const {
+    const int channel_size = height_ * width_;
+    const int col_size = kernel_h_ * kernel_w_ * output_h_ * output_w_;
+    if (im2col_) {
+      Run(data_in_ + channel * channel_size, data_out_ + channel * col_size);
+    } else {
+      Run(data_out_ + channel * channel_size, data_in_ + channel * col_size);
+    }
+  }
+
+ private:
+  // Copies from data_im to data_col, or accumulates the other way.
+  template <typename ImPtr, typename ColPtr>
+  void Run(ImPtr data_im, ColPtr data_col) const {
+    for (int kernel_row = 0; kernel_row < kernel_h_; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kernel_w_; kernel_col++) {
+        const int input_col = -pad_w_ + kernel_col * dilation_w_;
+        int begin, end;
+        valid_columns(input_col, stride_w_, width_, output_w_, &begin, &end);
+        int input_row = -pad_h_ + kernel_row * dilation_h_;
+        for (int output_row = 0; output_row < output_h_; output_row++) {
+          if (is_a_ge_zero_and_a_lt_b(input_row, height_)) {
+            const int offset = input_row * width_ + input_col;
+            Row(data_im, offset, begin, end, data_col);
           } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                *(data_col++) = data_im[input_row * width + input_col];
-              } else {
-                *(data_col++) = 0;
-              }
-              input_col += stride_w;
-            }
+            Row(data_im, 0, 0, 0, data_col);
           }
-          input_row += stride_h;
+          data_col += output_w_;
+          input_row += stride_h_;
         }
       }
     }
   }
+  void Row(const Dtype* data_im, const int offset, const int begin,
+      const int end, Dtype* data_col) const {
+    for (int i = 0; i < begin; ++i) { data_col[i] = 0; }
+    for (int i = begin; i < end; ++i) {
+      data_col[i] = data_im[offset + i * stride_w_];
+    }
+    for (int i = end; i < output_w_; ++i) { data_col[i] = 0; }
+  }
+  void Row(Dtype* data_im, const int offset, const int begin, const int end,
+      const Dtype* data_col) const {
+    for (int i = begin; i < end; ++i) {
+      data_im[offset + i * stride_w_] += data_col[i];
+    }
+  }
+
+  const bool im2col_;
+  const int height_, width_, kernel_h_, kernel_w_, pad_h_, pad_w_;
+  const int stride_h_, stride_w_, dilation_h_, dilation_w_;
+  const int output_h_, output_w_;
+  const Dtype* data_in_;
+  Dtype* data_out_;
+};
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  cpu_dispatch_for(channels, Im2colChannel<Dtype>(true, height, width,
+      kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h,
+      dilation_w, data_im, data_col));
 }
 
 // Explicit instantiation
@@ -167,33 +230,9 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int dilation_h, const int dilation_w,
     Dtype* data_im) {
   caffe_set(height * width * channels, Dtype(0), data_im);
-  const int output_h = (height + 2 * pad_h -
-    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
-  const int output_w = (width + 2 * pad_w -
-    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
-  const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            data_col += output_w;
-          } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                data_im[input_row * width + input_col] += *data_col;
-              }
-              data_col++;
-              input_col += stride_w;
-            }
-          }
-          input_row += stride_h;
-        }
-      }
-    }
-  }
+  cpu_dispatch_for(channels, Im2colChannel<Dtype>(false, height, width,
+      kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h,
+      dilation_w, data_col, data_im));
 }
 
 // Explicit instantiation
@@ -0,0 +1,222 @@
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/insert_layouts.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Layers computing each element of their tops from the elements at the same
+// position in their bottoms, which therefore do not depend on the layout.
+bool IsElementwise(const LayerParameter& layer_param) {
+  const char* types[] = {"AbsVal", "BNLL", "Dropout", "Eltwise", "ELU", "Exp",
+                         "Log", "Power", "ReLU", "Sigmoid", "Silence", "TanH",
+                         "Threshold"};
+  for (int i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+    if (layer_param.type() == types[i]) { return true; }
+  }
+  return false;
+}
+
+template <typename T>
+bool AllEqual(const google::protobuf::RepeatedField<T>& values, int value) {
+  for (int i = 0; i < values.size(); ++i) {
+    if (values.Get(i) != static_cast<T>(value)) { return false; }
+  }
+  return true;
+}
+
+// The blobs of the net and the layouts their current values are in, as the
+// layers are added one by one.
+class LayoutTracker {
+ public:
+  // Reserves the names of the layers and blobs of the net in param.
+  LayoutTracker(const NetParameter& param, NetParameter* param_layouts)
+      : param_(param_layouts) {
+    names_.insert(param.input().begin(), param.input().end());
+    for (int i = 0; i < param.layer_size(); ++i) {
+      names_.insert(param.layer(i).name());
+      names_.insert(param.layer(i).top().begin(), param.layer(i).top().end());
+    }
+  }
+
+  void AddNCHW(const string& blob_name) {
+    nchw_.insert(blob_name);
+    produced_.insert(blob_name);
+  }
+  bool IsNHWCOnly(const string& blob_name) const {
+    return nhwc_.count(blob_name) && !nchw_.count(blob_name);
+  }
+  // The name of a blob holding the current value of blob_name in layout,
+  // converting it first if needed.
+  string Get(const string& blob_name, bool channels_last) {
+    if (channels_last) {
+      if (!nhwc_.count(blob_name)) {
+        const string converted = UniqueName(blob_name + "_nhwc");
+        AddLayout(blob_name, converted, LayoutParameter_Layout_NHWC);
+        nhwc_[blob_name] = converted;
+      }
+      return nhwc_[blob_name];
+    }
+    if (!nchw_.count(blob_name)) {
+      CHECK(nhwc_.count(blob_name)) << "Unknown blob '" << blob_name << "'";
+      // Only blobs first produced in NHWC lack an NCHW value, so the name is
+      // still free.
+      CHECK(!produced_.count(blob_name));
+      AddLayout(nhwc_[blob_name], blob_name, LayoutParameter_Layout_NCHW);
+      nchw_.insert(blob_name);
+      produced_.insert(blob_name);
+    }
+    return blob_name;
+  }
+  // Records that blob_name was written in layout, by a layer with top
+  // renamed to the returned name.
+  string Set(const string& blob_name, bool channels_last, bool in_place) {
+    if (channels_last) {
+      nchw_.erase(blob_name);
+      if (!in_place) {
+        nhwc_[blob_name] = UniqueName(blob_name + "_nhwc");
+      }
+      return nhwc_[blob_name];
+    }
+    nhwc_.erase(blob_name);
+    AddNCHW(blob_name);
+    return blob_name;
+  }
+
+ private:
+  string UniqueName(const string& name) {
+    string unique = name;
+    for (int i = 1; names_.count(unique); ++i) {
+      unique = name + "_" + format_int(i);
+    }
+    names_.insert(unique);
+    return unique;
+  }
+  void AddLayout(const string& bottom, const string& top,
+      LayoutParameter_Layout layout) {
+    LayerParameter* layer_param = param_->add_layer();
+    layer_param->set_name(UniqueName(top + "_layout"));
+    layer_param->set_type("Layout");
+    layer_param->add_bottom(bottom);
+    layer_param->add_top(top);
+    layer_param->mutable_layout_param()->set_layout(layout);
+  }
+
+  NetParameter* param_;
+  // The blobs whose current value is in NCHW under their own name.
+  set<string> nchw_;
+  // The blobs whose current value is in NHWC, and the names holding it.
+  map<string, string> nhwc_;
+  // The blobs given an NCHW value so far.
+  set<string> produced_;
+  // The names of the layers and blobs, to keep the new ones unique.
+  set<string> names_;
+};
+
+}  // namespace
+
+bool SupportsChannelsLast(const ConvolutionParameter& conv_param) {
+  if (conv_param.layout() == LayoutParameter_Layout_NHWC) { return true; }
+  if (conv_param.group() != 1 || conv_param.axis() != 1 ||
+      conv_param.engine() == ConvolutionParameter_Engine_CUDNN ||
+      conv_param.force_nd_im2col()) {
+    return false;
+  }
+  if (conv_param.has_kernel_h() || conv_param.has_kernel_w()) {
+    if (conv_param.kernel_h() != 1 || conv_param.kernel_w() != 1) {
+      return false;
+    }
+  } else if (conv_param.kernel_size_size() == 0 ||
+             !AllEqual(conv_param.kernel_size(), 1)) {
+    return false;
+  }
+  if (conv_param.has_stride_h() || conv_param.has_stride_w()) {
+    if (conv_param.stride_h() != 1 || conv_param.stride_w() != 1) {
+      return false;
+    }
+  } else if (!AllEqual(conv_param.stride(), 1)) {
+    return false;
+  }
+  if (conv_param.has_pad_h() || conv_param.has_pad_w()) {
+    if (conv_param.pad_h() != 0 || conv_param.pad_w() != 0) {
+      return false;
+    }
+  } else if (!AllEqual(conv_param.pad(), 0)) {
+    return false;
+  }
+  return true;
+}
+
+void InsertLayouts(const NetParameter& param, NetParameter* param_layouts) {
+  // Initialize by copying from the input NetParameter.
+  param_layouts->CopyFrom(param);
+  if (param.internal_layout() != LayoutParameter_Layout_NHWC) {
+    return;
+  }
+  param_layouts->clear_layer();
+  LayoutTracker tracker(param, param_layouts);
+  // The outputs of the net: the blobs left unconsumed by the later layers.
+  set<string> outputs;
+  for (int i = 0; i < param.input_size(); ++i) {
+    tracker.AddNCHW(param.input(i));
+    outputs.insert(param.input(i));
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      outputs.erase(layer_param.bottom(j));
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      outputs.insert(layer_param.top(j));
+    }
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    bool channels_last = false;
+    if (layer_param.type() == "Convolution") {
+      channels_last = SupportsChannelsLast(layer_param.convolution_param());
+    } else if (IsElementwise(layer_param) && layer_param.bottom_size() > 0) {
+      // Stay in NHWC rather than converting back.
+      channels_last = true;
+      for (int j = 0; j < layer_param.bottom_size(); ++j) {
+        channels_last &= tracker.IsNHWCOnly(layer_param.bottom(j));
+      }
+    }
+    // Convert the bottoms first, so that the Layout layers come before.
+    vector<string> bottoms;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      bottoms.push_back(tracker.Get(layer_param.bottom(j), channels_last));
+    }
+    LayerParameter* new_layer_param = param_layouts->add_layer();
+    new_layer_param->CopyFrom(layer_param);
+    for (int j = 0; j < bottoms.size(); ++j) {
+      new_layer_param->set_bottom(j, bottoms[j]);
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const bool in_place = j < layer_param.bottom_size() &&
+          layer_param.top(j) == layer_param.bottom(j);
+      new_layer_param->set_top(j,
+          tracker.Set(layer_param.top(j), channels_last, in_place));
+    }
+    if (channels_last && layer_param.type() == "Convolution") {
+      // Only the CAFFE engine implements NHWC.
+      ConvolutionParameter* conv_param =
+          new_layer_param->mutable_convolution_param();
+      conv_param->set_layout(LayoutParameter_Layout_NHWC);
+      conv_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+    }
+  }
+  // Hand the outputs back in NCHW.
+  for (set<string>::const_iterator it = outputs.begin(); it != outputs.end();
+       ++it) {
+    tracker.Get(*it, false);
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/vector_math.hpp"
 
 namespace caffe {
 
@@ -226,6 +227,28 @@ void caffe_abs<double>(const int n, const double* a, double* y) {
     vdAbs(n, a, y);
 }
 
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+  vsTanh(n, a, y);
+}
+
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+  vdTanh(n, a, y);
+}
+
+template <>
+void caffe_sigmoid<float>(const int n, const float* a, float* y) {
+  vector_sigmoid(n, a, y);
+}
+
+template <>
+void caffe_sigmoid<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + exp(-a[i]));
+  }
+}
+
 unsigned int caffe_rng_rand() {
   return (*caffe_rng())();
 }
@@ -0,0 +1,199 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/memory_tracker.hpp"
+
+namespace caffe {
+
+class MemoryTracker::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+namespace {
+
+// The accounts are owned by the tracker, not the threads.
+void Keep(MemoryTracker::Account* account) {}
+
+boost::thread_specific_ptr<MemoryTracker::Account>& current_account() {
+  static boost::thread_specific_ptr<MemoryTracker::Account> account(&Keep);
+  return account;
+}
+
+bool ComparePeaks(const MemoryTracker::Account& a,
+    const MemoryTracker::Account& b) {
+  return a.peak_bytes > b.peak_bytes;
+}
+
+string Megabytes(size_t bytes) {
+  std::ostringstream megabytes;
+  megabytes << std::fixed << std::setprecision(2)
+            << bytes / (1024. * 1024.) << " MB";
+  return megabytes.str();
+}
+
+}  // namespace
+
+const char* MemoryTracker::kind_name(int kind) {
+  static const char* names[NUM_KINDS] = {
+    "data", "diff", "params", "col_buffer", "solver_history", "prefetch",
+    "other"
+  };
+  CHECK_GE(kind, 0);
+  CHECK_LT(kind, NUM_KINDS);
+  return names[kind];
+}
+
+MemoryTracker::Scope::Scope(const string& owner, Kind kind)
+    : previous_(current_account().get()) {
+  current_account().reset(MemoryTracker::Get()->account(owner, kind));
+}
+
+MemoryTracker::Scope::Scope(Account* account)
+    : previous_(current_account().get()) {
+  current_account().reset(account);
+}
+
+MemoryTracker::Scope::~Scope() {
+  current_account().reset(previous_);
+}
+
+MemoryTracker::MemoryTracker()
+    : live_bytes_(0), peak_bytes_(0), kind_live_bytes_(NUM_KINDS, 0),
+      kind_peak_bytes_(NUM_KINDS, 0), sync_(new sync()) {
+  untracked_ = account("", OTHER);
+}
+
+MemoryTracker* MemoryTracker::Get() {
+  // Never destroyed, as memory may be freed during static destruction.
+  static MemoryTracker* tracker = new MemoryTracker();
+  return tracker;
+}
+
+MemoryTracker::Account* MemoryTracker::account(const string& owner,
+    Kind kind) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  Account& account = accounts_[std::make_pair(owner, static_cast<int>(kind))];
+  account.owner = owner;
+  account.kind = kind;
+  return &account;
+}
+
+MemoryTracker::Account* MemoryTracker::current() {
+  Account* account = current_account().get();
+  return account ? account : untracked_;
+}
+
+MemoryTracker::Account* MemoryTracker::diff_account(Account* account) {
+  return account->kind == DATA ? this->account(account->owner, DIFF) :
+      account;
+}
+
+void MemoryTracker::Allocate(Account* account, size_t bytes) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  account->live_bytes += bytes;
+  account->peak_bytes = std::max(account->peak_bytes, account->live_bytes);
+  ++account->allocations;
+  kind_live_bytes_[account->kind] += bytes;
+  kind_peak_bytes_[account->kind] = std::max(kind_peak_bytes_[account->kind],
+      kind_live_bytes_[account->kind]);
+  live_bytes_ += bytes;
+  peak_bytes_ = std::max(peak_bytes_, live_bytes_);
+}
+
+void MemoryTracker::Free(Account* account, size_t bytes) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  CHECK_GE(account->live_bytes, bytes);
+  account->live_bytes -= bytes;
+  --account->allocations;
+  kind_live_bytes_[account->kind] -= bytes;
+  live_bytes_ -= bytes;
+}
+
+void MemoryTracker::Move(Account* from, Account* to, size_t bytes) {
+  if (from == to) { return; }
+  Free(from, bytes);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  // Moving does not raise the total.
+  to->live_bytes += bytes;
+  to->peak_bytes = std::max(to->peak_bytes, to->live_bytes);
+  ++to->allocations;
+  kind_live_bytes_[to->kind] += bytes;
+  kind_peak_bytes_[to->kind] = std::max(kind_peak_bytes_[to->kind],
+      kind_live_bytes_[to->kind]);
+  live_bytes_ += bytes;
+}
+
+size_t MemoryTracker::live_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return live_bytes_;
+}
+
+size_t MemoryTracker::peak_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return peak_bytes_;
+}
+
+size_t MemoryTracker::live_bytes(Kind kind) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return kind_live_bytes_[kind];
+}
+
+size_t MemoryTracker::peak_bytes(Kind kind) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return kind_peak_bytes_[kind];
+}
+
+vector<MemoryTracker::Account> MemoryTracker::accounts() const {
+  vector<Account> accounts;
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    for (std::map<std::pair<string, int>, Account>::const_iterator it =
+         accounts_.begin(); it != accounts_.end(); ++it) {
+      accounts.push_back(it->second);
+    }
+  }
+  std::stable_sort(accounts.begin(), accounts.end(), ComparePeaks);
+  return accounts;
+}
+
+void MemoryTracker::ResetPeaks() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  for (std::map<std::pair<string, int>, Account>::iterator it =
+       accounts_.begin(); it != accounts_.end(); ++it) {
+    it->second.peak_bytes = it->second.live_bytes;
+  }
+  kind_peak_bytes_ = kind_live_bytes_;
+  peak_bytes_ = live_bytes_;
+}
+
+void MemoryTracker::LogReport(int top_accounts) const {
+  LOG(INFO) << "Host memory: " << Megabytes(live_bytes()) << " live, "
+            << Megabytes(peak_bytes()) << " peak";
+  for (int kind = 0; kind < NUM_KINDS; ++kind) {
+    const Kind k = static_cast<Kind>(kind);
+    if (peak_bytes(k) == 0) { continue; }
+    LOG(INFO) << std::setw(16) << kind_name(kind) << ": "
+              << Megabytes(live_bytes(k)) << " live, "
+              << Megabytes(peak_bytes(k)) << " peak";
+  }
+  const vector<Account> accounts = this->accounts();
+  for (int i = 0; i < accounts.size() && i < top_accounts; ++i) {
+    const Account& account = accounts[i];
+    if (account.peak_bytes == 0) { break; }
+    LOG(INFO) << std::setw(16)
+              << (account.owner.empty() ? "(untracked)" : account.owner)
+              << " " << std::setw(14) << kind_name(account.kind) << ": "
+              << Megabytes(account.live_bytes) << " live, "
+              << Megabytes(account.peak_bytes) << " peak in "
+              << account.allocations << " allocations";
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,103 @@
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "caffe/util/perf_counters.hpp"
+
+namespace caffe {
+
+namespace {
+
+#ifdef __linux__
+const uint32_t kTypes[PerfCounters::NUM_COUNTERS] = {
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE
+};
+const uint64_t kConfigs[PerfCounters::NUM_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_PAGE_FAULTS
+};
+#endif
+
+void DeleteCounters(PerfCounters* counters) {
+  delete counters;
+}
+
+}  // namespace
+
+const char* PerfCounters::name(int counter) {
+  static const char* names[NUM_COUNTERS] = {
+    "cycles", "instructions", "cache_references", "cache_misses",
+    "branch_misses", "page_faults"
+  };
+  CHECK_GE(counter, 0);
+  CHECK_LT(counter, NUM_COUNTERS);
+  return names[counter];
+}
+
+PerfCounters* PerfCounters::ForThread() {
+  static boost::thread_specific_ptr<PerfCounters> counters(&DeleteCounters);
+  if (!counters.get()) {
+    counters.reset(new PerfCounters());
+  }
+  return counters.get();
+}
+
+PerfCounters::PerfCounters()
+    : fds_(NUM_COUNTERS, -1) {
+#ifdef __linux__
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    struct perf_event_attr attr = perf_event_attr();
+    attr.size = sizeof(attr);
+    attr.type = kTypes[i];
+    attr.config = kConfigs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This thread, on any CPU.
+    fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+  if (!any_available()) {
+    LOG_FIRST_N(WARNING, 1) << "No performance counters available; check "
+                            << "/proc/sys/kernel/perf_event_paranoid.";
+  }
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (fds_[i] >= 0) { close(fds_[i]); }
+  }
+#endif
+}
+
+bool PerfCounters::any_available() const {
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (available(i)) { return true; }
+  }
+  return false;
+}
+
+void PerfCounters::Read(vector<uint64_t>* values) const {
+  values->assign(NUM_COUNTERS, 0);
+#ifdef __linux__
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (fds_[i] < 0) { continue; }
+    // The count, and the times the counter was enabled and running.
+    uint64_t data[3];
+    if (read(fds_[i], data, sizeof(data)) != sizeof(data)) { continue; }
+    (*values)[i] = data[2] == 0 ? 0 : data[2] == data[1] ? data[0] :
+        static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] /
+        data[2]);
+  }
+#endif
+}
+
+}  // namespace caffe
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "caffe/util/cpu_features.hpp"
+#include "caffe/util/pooling.hpp"
+
+namespace caffe {
+
+namespace {
+
+using std::max;
+using std::min;
+
+struct PoolingWindows {
+  int height, width;
+  int kernel_h, kernel_w;
+  int pad_h, pad_w;
+  int stride_h, stride_w;
+  int pooled_height, pooled_width;
+};
+
+// The select of the masked kernel's `if (value > max) max = value`.
+template <typename Dtype>
+inline Dtype pool_max(const Dtype current, const Dtype value) {
+  return value > current ? value : current;
+}
+
+// Adds one input row into n consecutive windows of an output row, the
+// first of which starts at row[0]. The kernel and stride are either given
+// at compile time or, when kKernel and kStride are 0, at run time.
+template <typename Dtype, bool kMax, int kKernel, int kStride>
+inline void pool_row(const Dtype* row, const int n, const int kernel,
+    const int stride, Dtype* out) {
+  const int k = kKernel ? kKernel : kernel;
+  const int s = kStride ? kStride : stride;
+  for (int kw = 0; kw < k; ++kw) {
+    const Dtype* in = row + kw;
+    for (int i = 0; i < n; ++i) {
+      out[i] = kMax ? pool_max(out[i], in[i * s]) : out[i] + in[i * s];
+    }
+  }
+}
+
+// Max or average pools plane p, without a mask.
+template <typename Dtype, bool kMax>
+struct PoolPlanes {
+  const Dtype* data;
+  PoolingWindows g;
+  Dtype* pooled;
+
+  // The window at pw of an output row, with the rows [hstart, hend) of the
+  // window inside the plane and pool_h of them counting the padding.
+  Dtype Window(const Dtype* in, const int pw, const int hstart,
+      const int hend, const int pool_h) const {
+    int wstart = pw * g.stride_w - g.pad_w;
+    int wend = min(wstart + g.kernel_w, g.width + g.pad_w);
+    const int pool_size = pool_h * (wend - wstart);
+    wstart = max(wstart, 0);
+    wend = min(wend, g.width);
+    Dtype value = kMax ? Dtype(-FLT_MAX) : Dtype(0);
+    for (int h = hstart; h < hend; ++h) {
+      for (int w = wstart; w < wend; ++w) {
+        value = kMax ? pool_max(value, in[h * g.width + w])
+            : value + in[h * g.width + w];
+      }
+    }
+    return kMax ? value : value / pool_size;
+  }
+
+  void operator()(const int p) const {
+    const Dtype* in = data + p * g.height * g.width;
+    Dtype* out = pooled + p * g.pooled_height * g.pooled_width;
+    const Dtype init = kMax ? Dtype(-FLT_MAX) : Dtype(0);
+    if (g.pooled_height == 1 && g.pooled_width == 1 &&
+        g.kernel_h - g.pad_h >= g.height && g.kernel_w - g.pad_w >= g.width) {
+      // Global pooling: reduce the plane into kLanes partial results, which
+      // vectorize, before combining them.
+      const int kLanes = 16;
+      const int count = g.height * g.width;
+      Dtype lanes[kLanes];
+      for (int j = 0; j < kLanes; ++j) { lanes[j] = init; }
+      int i = 0;
+      for (; i + kLanes <= count; i += kLanes) {
+        for (int j = 0; j < kLanes; ++j) {
+          lanes[j] = kMax ? pool_max(lanes[j], in[i + j])
+              : lanes[j] + in[i + j];
+        }
+      }
+      Dtype value = init;
+      for (; i < count; ++i) {
+        value = kMax ? pool_max(value, in[i]) : value + in[i];
+      }
+      for (int j = 0; j < kLanes; ++j) {
+        value = kMax ? pool_max(value, lanes[j]) : value + lanes[j];
+      }
+      const int pool_size =
+          (min(g.kernel_h - g.pad_h, g.height + g.pad_h) + g.pad_h) *
+          (min(g.kernel_w - g.pad_w, g.width + g.pad_w) + g.pad_w);
+      out[0] = kMax ? value : value / pool_size;
+      return;
+    }
+    // The windows from pw_begin to pw_end lie inside the plane along the
+    // rows, and run without clipping.
+    const int pw_begin = min((g.pad_w + g.stride_w - 1) / g.stride_w,
+        g.pooled_width);
+    int pw_end = g.width + g.pad_w >= g.kernel_w ?
+        (g.width + g.pad_w - g.kernel_w) / g.stride_w + 1 : 0;
+    pw_end = max(pw_begin, min(pw_end, g.pooled_width));
+    const int n = pw_end - pw_begin;
+    for (int ph = 0; ph < g.pooled_height; ++ph) {
+      int hstart = ph * g.stride_h - g.pad_h;
+      int hend = min(hstart + g.kernel_h, g.height + g.pad_h);
+      const int pool_h = hend - hstart;
+      hstart = max(hstart, 0);
+      hend = min(hend, g.height);
+      Dtype* out_row = out + ph * g.pooled_width;
+      for (int pw = 0; pw < pw_begin; ++pw) {
+        out_row[pw] = Window(in, pw, hstart, hend, pool_h);
+      }
+      for (int pw = pw_end; pw < g.pooled_width; ++pw) {
+        out_row[pw] = Window(in, pw, hstart, hend, pool_h);
+      }
+      if (n == 0) { continue; }
+      Dtype* interior = out_row + pw_begin;
+      for (int i = 0; i < n; ++i) { interior[i] = init; }
+      for (int h = hstart; h < hend; ++h) {
+        const Dtype* row =
+            in + h * g.width + pw_begin * g.stride_w - g.pad_w;
+        if (g.kernel_w == 2 && g.stride_w == 2) {
+          pool_row<Dtype, kMax, 2, 2>(row, n, 2, 2, interior);
+        } else if (g.kernel_w == 3 && g.stride_w == 2) {
+          pool_row<Dtype, kMax, 3, 2>(row, n, 3, 2, interior);
+        } else {
+          pool_row<Dtype, kMax, 0, 0>(row, n, g.kernel_w, g.stride_w,
+              interior);
+        }
+      }
+      if (!kMax) {
+        const int pool_size = pool_h * g.kernel_w;
+        for (int i = 0; i < n; ++i) { interior[i] /= pool_size; }
+      }
+    }
+  }
+};
+
+// Max pools plane p, recording the index of each maximum.
+template <typename Dtype>
+struct MaxPoolPlanesWithMask {
+  const Dtype* data;
+  PoolingWindows g;
+  Dtype* pooled;
+  int* mask;
+  void operator()(const int p) const {
+    const Dtype* in = data + p * g.height * g.width;
+    const int offset = p * g.pooled_height * g.pooled_width;
+    for (int ph = 0; ph < g.pooled_height; ++ph) {
+      for (int pw = 0; pw < g.pooled_width; ++pw) {
+        int hstart = ph * g.stride_h - g.pad_h;
+        int wstart = pw * g.stride_w - g.pad_w;
+        int hend = min(hstart + g.kernel_h, g.height);
+        int wend = min(wstart + g.kernel_w, g.width);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        Dtype value = -FLT_MAX;
+        int index = -1;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            if (in[h * g.width + w] > value) {
+              value = in[h * g.width + w];
+              index = h * g.width + w;
+            }
+          }
+        }
+        const int pool_index = offset + ph * g.pooled_width + pw;
+        pooled[pool_index] = value;
+        mask[pool_index] = index;
+      }
+    }
+  }
+};
+
+template <typename Dtype>
+struct MaxPoolBackwardPlanes {
+  const Dtype* pooled_diff;
+  const int* mask;
+  int plane_size;
+  int pooled_size;
+  Dtype* diff;
+  void operator()(const int p) const {
+    Dtype* plane_diff = diff + p * plane_size;
+    const int offset = p * pooled_size;
+    for (int i = 0; i < pooled_size; ++i) {
+      plane_diff[mask[offset + i]] += pooled_diff[offset + i];
+    }
+  }
+};
+
+template <typename Dtype>
+struct AvePoolBackwardPlanes {
+  const Dtype* pooled_diff;
+  PoolingWindows g;
+  Dtype* diff;
+  void operator()(const int p) const {
+    const Dtype* out_diff =
+        pooled_diff + p * g.pooled_height * g.pooled_width;
+    Dtype* in_diff = diff + p * g.height * g.width;
+    for (int ph = 0; ph < g.pooled_height; ++ph) {
+      for (int pw = 0; pw < g.pooled_width; ++pw) {
+        int hstart = ph * g.stride_h - g.pad_h;
+        int wstart = pw * g.stride_w - g.pad_w;
+        int hend = min(hstart + g.kernel_h, g.height + g.pad_h);
+        int wend = min(wstart + g.kernel_w, g.width + g.pad_w);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, g.height);
+        wend = min(wend, g.width);
+        const Dtype value = out_diff[ph * g.pooled_width + pw] / pool_size;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            in_diff[h * g.width + w] += value;
+          }
+        }
+      }
+    }
+  }
+};
+
+}  // namespace
+
+template <typename Dtype>
+void max_pool_cpu(const Dtype* data, const int num, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* pooled,
+    int* mask) {
+  const PoolingWindows windows = {height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, pooled_height, pooled_width};
+  if (mask) {
+    const MaxPoolPlanesWithMask<Dtype> pool = {data, windows, pooled, mask};
+    cpu_parallel_dispatch_for(num, pool);
+  } else {
+    const PoolPlanes<Dtype, true> pool = {data, windows, pooled};
+    cpu_parallel_dispatch_for(num, pool);
+  }
+}
+
+template void max_pool_cpu<float>(const float* data, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, float* pooled,
+    int* mask);
+template void max_pool_cpu<double>(const double* data, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, double* pooled,
+    int* mask);
+
+template <typename Dtype>
+void ave_pool_cpu(const Dtype* data, const int num, const int height,
+    const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* pooled) {
+  const PoolingWindows windows = {height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, pooled_height, pooled_width};
+  const PoolPlanes<Dtype, false> pool = {data, windows, pooled};
+  cpu_parallel_dispatch_for(num, pool);
+}
+
+template void ave_pool_cpu<float>(const float* data, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, float* pooled);
+template void ave_pool_cpu<double>(const double* data, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, double* pooled);
+
+template <typename Dtype>
+void max_pool_backward_cpu(const Dtype* pooled_diff, const int* mask,
+    const int num, const int height, const int width,
+    const int pooled_height, const int pooled_width, Dtype* diff) {
+  const MaxPoolBackwardPlanes<Dtype> backward = {pooled_diff, mask,
+      height * width, pooled_height * pooled_width, diff};
+  cpu_parallel_dispatch_for(num, backward);
+}
+
+template void max_pool_backward_cpu<float>(const float* pooled_diff,
+    const int* mask, const int num, const int height, const int width,
+    const int pooled_height, const int pooled_width, float* diff);
+template void max_pool_backward_cpu<double>(const double* pooled_diff,
+    const int* mask, const int num, const int height, const int width,
+    const int pooled_height, const int pooled_width, double* diff);
+
+template <typename Dtype>
+void ave_pool_backward_cpu(const Dtype* pooled_diff, const int num,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int pooled_height, const int pooled_width, Dtype* diff) {
+  const PoolingWindows windows = {height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, pooled_height, pooled_width};
+  const AvePoolBackwardPlanes<Dtype> backward = {pooled_diff, windows, diff};
+  cpu_parallel_dispatch_for(num, backward);
+}
+
+template void ave_pool_backward_cpu<float>(const float* pooled_diff,
+    const int num, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int pooled_height, const int pooled_width,
+    float* diff);
+template void ave_pool_backward_cpu<double>(const double* pooled_diff,
+    const int num, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int pooled_height, const int pooled_width,
+    double* diff);
+
+}  // namespace caffe
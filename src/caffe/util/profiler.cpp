@@ -0,0 +1,304 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/perf_counters.hpp"
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+class Profiler::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+bool Profiler::enabled_ = false;
+bool Profiler::counters_enabled_ = false;
+
+namespace {
+
+// The figures reported for a pass.
+struct PassReport {
+  explicit PassReport(const Profiler::Pass& pass, double peak_gflops,
+      double peak_gbps)
+      : calls(pass.microseconds.size()), mean_us(0), p50_us(0), p90_us(0),
+        p99_us(0), flops(0), bytes(0), gflops(0), gbps(0), intensity(0),
+        efficiency(0), bound(""), ipc(-1), cache_miss_rate(-1) {
+    if (calls == 0) { return; }
+    double total_us = 0;
+    for (int i = 0; i < calls; ++i) {
+      total_us += pass.microseconds[i];
+    }
+    mean_us = total_us / calls;
+    p50_us = Profiler::Percentile(pass.microseconds, 50);
+    p90_us = Profiler::Percentile(pass.microseconds, 90);
+    p99_us = Profiler::Percentile(pass.microseconds, 99);
+    flops = pass.flops / calls;
+    bytes = pass.bytes / calls;
+    if (total_us > 0) {
+      gflops = pass.flops / total_us / 1e3;
+      gbps = pass.bytes / total_us / 1e3;
+    }
+    if (pass.bytes > 0) {
+      intensity = pass.flops / pass.bytes;
+    }
+    if (peak_gflops > 0 && peak_gbps > 0) {
+      bound = intensity < peak_gflops / peak_gbps ? "memory" : "compute";
+      const double attainable = std::min(peak_gflops, intensity * peak_gbps);
+      if (attainable > 0) { efficiency = gflops / attainable; }
+    }
+    for (int i = 0; i < pass.counters.size(); ++i) {
+      counters.push_back(pass.counters[i] < 0 ? -1 : pass.counters[i] / calls);
+    }
+    if (counters.empty()) { return; }
+    if (counters[PerfCounters::CYCLES] > 0 &&
+        counters[PerfCounters::INSTRUCTIONS] >= 0) {
+      ipc = counters[PerfCounters::INSTRUCTIONS] /
+          counters[PerfCounters::CYCLES];
+    }
+    if (counters[PerfCounters::CACHE_REFERENCES] > 0 &&
+        counters[PerfCounters::CACHE_MISSES] >= 0) {
+      cache_miss_rate = counters[PerfCounters::CACHE_MISSES] /
+          counters[PerfCounters::CACHE_REFERENCES];
+    }
+  }
+
+  int calls;
+  double mean_us;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  // Per call.
+  double flops;
+  double bytes;
+  double gflops;
+  double gbps;
+  // FLOPs per byte, and the fraction of the roofline achieved.
+  double intensity;
+  double efficiency;
+  string bound;
+  // The PerfCounters per call, and the instructions per cycle and last level
+  // cache miss rate; -1 where unavailable.
+  vector<double> counters;
+  double ipc;
+  double cache_miss_rate;
+};
+
+void WritePassJSON(const PassReport& report, std::ostream* out) {
+  *out << "{\"calls\": " << report.calls
+       << ", \"mean_us\": " << report.mean_us
+       << ", \"p50_us\": " << report.p50_us
+       << ", \"p90_us\": " << report.p90_us
+       << ", \"p99_us\": " << report.p99_us
+       << ", \"flops\": " << report.flops
+       << ", \"bytes\": " << report.bytes
+       << ", \"gflops_per_s\": " << report.gflops
+       << ", \"gb_per_s\": " << report.gbps
+       << ", \"flops_per_byte\": " << report.intensity
+       << ", \"bound\": " << format_json_string(report.bound)
+       << ", \"roofline_efficiency\": " << report.efficiency;
+  if (!report.counters.empty()) {
+    *out << ", \"counters\": {";
+    bool first = true;
+    for (int i = 0; i < report.counters.size(); ++i) {
+      if (report.counters[i] < 0) { continue; }
+      *out << (first ? "" : ", ") << "\"" << PerfCounters::name(i) << "\": "
+           << report.counters[i];
+      first = false;
+    }
+    *out << "}";
+    if (report.ipc >= 0) {
+      *out << ", \"ipc\": " << report.ipc;
+    }
+    if (report.cache_miss_rate >= 0) {
+      *out << ", \"cache_miss_rate\": " << report.cache_miss_rate;
+    }
+  }
+  *out << "}";
+}
+
+// Writes value, or nothing if it is unavailable.
+void WriteCSVValue(double value, std::ostream* out) {
+  *out << ",";
+  if (value >= 0) { *out << value; }
+}
+
+void WritePassCSV(const PassReport& report, std::ostream* out) {
+  *out << report.calls << "," << report.mean_us << "," << report.p50_us
+       << "," << report.p90_us << "," << report.p99_us << ","
+       << report.flops << "," << report.bytes << "," << report.gflops << ","
+       << report.gbps << "," << report.intensity << "," << report.bound << ","
+       << report.efficiency;
+  for (int i = 0; i < PerfCounters::NUM_COUNTERS; ++i) {
+    WriteCSVValue(report.counters.empty() ? -1 : report.counters[i], out);
+  }
+  WriteCSVValue(report.ipc, out);
+  WriteCSVValue(report.cache_miss_rate, out);
+}
+
+}  // namespace
+
+Profiler::Profiler()
+    : sync_(new sync()), peak_gflops_(0), peak_gbps_(0) {
+}
+
+Profiler* Profiler::Get() {
+  static Profiler profiler;
+  return &profiler;
+}
+
+void Profiler::Record(const string& name, const string& type,
+    const string& shape, bool backward, float microseconds, double flops,
+    double bytes, double top_bytes, double param_bytes,
+    const vector<double>& counters) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  const string key = name + "\n" + type;
+  map<string, int>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    it = index_.insert(make_pair(key, static_cast<int>(profiles_.size())))
+        .first;
+    profiles_.push_back(LayerProfile());
+    profiles_.back().name = name;
+    profiles_.back().type = type;
+  }
+  LayerProfile& profile = profiles_[it->second];
+  Pass& pass = backward ? profile.backward : profile.forward;
+  pass.microseconds.push_back(microseconds);
+  pass.flops += flops;
+  pass.bytes += bytes;
+  if (!counters.empty()) {
+    if (pass.counters.empty()) {
+      pass.counters.assign(counters.size(), 0);
+    }
+    CHECK_EQ(pass.counters.size(), counters.size());
+    for (int i = 0; i < counters.size(); ++i) {
+      pass.counters[i] = counters[i] < 0 || pass.counters[i] < 0 ? -1 :
+          pass.counters[i] + counters[i];
+    }
+  }
+  profile.shape = shape;
+  profile.top_bytes = std::max(profile.top_bytes, top_bytes);
+  profile.param_bytes = param_bytes;
+}
+
+void Profiler::Clear() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  profiles_.clear();
+  index_.clear();
+}
+
+vector<Profiler::LayerProfile> Profiler::profiles() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return profiles_;
+}
+
+void Profiler::set_peak(double gflops, double gbps) {
+  CHECK_GE(gflops, 0);
+  CHECK_GE(gbps, 0);
+  peak_gflops_ = gflops;
+  peak_gbps_ = gbps;
+}
+
+void Profiler::WriteJSON(std::ostream* out) const {
+  const vector<LayerProfile> layers = profiles();
+  *out << "{\"peak_gflops_per_s\": " << peak_gflops_
+       << ", \"peak_gb_per_s\": " << peak_gbps_ << ", \"layers\": [";
+  for (int i = 0; i < layers.size(); ++i) {
+    *out << (i ? ",\n  " : "\n  ") << "{\"name\": "
+         << format_json_string(layers[i].name) << ", \"type\": "
+         << format_json_string(layers[i].type) << ", \"shape\": "
+         << format_json_string(layers[i].shape) << ", \"top_bytes\": "
+         << layers[i].top_bytes << ", \"param_bytes\": "
+         << layers[i].param_bytes << ",\n   \"forward\": ";
+    WritePassJSON(PassReport(layers[i].forward, peak_gflops_, peak_gbps_),
+        out);
+    *out << ",\n   \"backward\": ";
+    WritePassJSON(PassReport(layers[i].backward, peak_gflops_, peak_gbps_),
+        out);
+    *out << "}";
+  }
+  *out << "\n]}\n";
+}
+
+void Profiler::WriteCSV(std::ostream* out) const {
+  const vector<LayerProfile> layers = profiles();
+  *out << "name,type,shape,direction,calls,mean_us,p50_us,p90_us,p99_us,"
+       << "flops,bytes,gflops_per_s,gb_per_s,flops_per_byte,bound,"
+       << "roofline_efficiency";
+  for (int i = 0; i < PerfCounters::NUM_COUNTERS; ++i) {
+    *out << "," << PerfCounters::name(i);
+  }
+  *out << ",ipc,cache_miss_rate,top_bytes,param_bytes\n";
+  for (int i = 0; i < layers.size(); ++i) {
+    for (int backward = 0; backward < 2; ++backward) {
+      const Pass& pass = backward ? layers[i].backward : layers[i].forward;
+      if (pass.microseconds.empty()) { continue; }
+      *out << layers[i].name << "," << layers[i].type << ","
+           << layers[i].shape << "," << (backward ? "backward" : "forward")
+           << ",";
+      WritePassCSV(PassReport(pass, peak_gflops_, peak_gbps_), out);
+      *out << "," << layers[i].top_bytes << "," << layers[i].param_bytes
+           << "\n";
+    }
+  }
+}
+
+void Profiler::Write(const string& filename) const {
+  std::ofstream out(filename.c_str());
+  CHECK(out.good()) << "Failed to open profile file " << filename;
+  out << std::setprecision(10);
+  const string csv = ".csv";
+  if (filename.size() >= csv.size() &&
+      filename.compare(filename.size() - csv.size(), csv.size(), csv) == 0) {
+    WriteCSV(&out);
+  } else {
+    WriteJSON(&out);
+  }
+  CHECK(out.good()) << "Failed to write profile file " << filename;
+}
+
+void Profiler::LogSummary() const {
+  const vector<LayerProfile> layers = profiles();
+  for (int i = 0; i < layers.size(); ++i) {
+    for (int backward = 0; backward < 2; ++backward) {
+      const Pass& pass = backward ? layers[i].backward : layers[i].forward;
+      if (pass.microseconds.empty()) { continue; }
+      const PassReport report(pass, peak_gflops_, peak_gbps_);
+      std::ostringstream counters;
+      if (report.ipc >= 0) {
+        counters << ", IPC " << report.ipc;
+      }
+      if (report.cache_miss_rate >= 0) {
+        counters << ", cache miss rate " << report.cache_miss_rate;
+      }
+      LOG(INFO) << std::setfill(' ') << std::setw(10) << layers[i].name
+          << " (" << layers[i].type << ")"
+          << (backward ? "\tbackward: " : "\tforward: ")
+          << "p50 " << report.p50_us / 1000 << " ms, p99 "
+          << report.p99_us / 1000 << " ms, " << report.gflops
+          << " GFLOP/s, " << report.gbps << " GB/s"
+          << (report.bound.empty() ? "" : ", " + report.bound + "-bound")
+          << counters.str();
+    }
+  }
+}
+
+float Profiler::Percentile(vector<float> values, double p) {
+  CHECK(!values.empty());
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 100);
+  // Nearest rank.
+  int rank = static_cast<int>(std::ceil(p / 100 * values.size())) - 1;
+  rank = std::max(rank, 0);
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
+}  // namespace caffe
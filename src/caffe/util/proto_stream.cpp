@@ -0,0 +1,355 @@
+#include <fcntl.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/util/proto_stream.hpp"
+
+namespace caffe {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+// The coded streams count bytes in an int, so they are re-created every
+// kStreamRefreshBytes, and raw values are copied kStreamChunkBytes at a time.
+const int kStreamRefreshBytes = 1 << 28;
+const int kStreamChunkBytes = 1 << 26;
+
+ProtoStreamWriter::ProtoStreamWriter(const string& filename)
+    : filename_(filename) {
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Couldn't open " << filename;
+  raw_output_.reset(new FileOutputStream(fd));
+  coded_output_.reset(new CodedOutputStream(raw_output_.get()));
+}
+
+ProtoStreamWriter::~ProtoStreamWriter() {
+  if (raw_output_) {
+    Close();
+  }
+}
+
+CodedOutputStream* ProtoStreamWriter::coded() {
+  if (coded_output_->ByteCount() >= kStreamRefreshBytes) {
+    CHECK(!coded_output_->HadError()) << "Error writing " << filename_;
+    coded_output_.reset();
+    coded_output_.reset(new CodedOutputStream(raw_output_.get()));
+  }
+  return coded_output_.get();
+}
+
+void ProtoStreamWriter::WriteFields(const Message& message) {
+  CHECK(message.SerializeToCodedStream(coded()))
+      << "Error writing " << filename_;
+}
+
+void ProtoStreamWriter::WriteLengthDelimited(int field_number,
+    uint64_t size) {
+  coded()->WriteTag(WireFormatLite::MakeTag(field_number,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  coded()->WriteVarint64(size);
+}
+
+void ProtoStreamWriter::WriteRaw(const void* data, uint64_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const int chunk = std::min<uint64_t>(size, kStreamChunkBytes);
+    coded()->WriteRaw(bytes, chunk);
+    bytes += chunk;
+    size -= chunk;
+  }
+}
+
+// BlobProto holds float blobs in data/diff and double blobs in
+// double_data/double_diff, as written by Blob::ToProto. Like protobuf itself,
+// the packed values are copied as-is, which assumes a little-endian host.
+template <typename Dtype>
+static int BlobDataField(bool diff) {
+  if (sizeof(Dtype) == sizeof(double)) {
+    return diff ? BlobProto::kDoubleDiffFieldNumber :
+        BlobProto::kDoubleDataFieldNumber;
+  }
+  return diff ? BlobProto::kDiffFieldNumber : BlobProto::kDataFieldNumber;
+}
+
+static uint64_t BlobShapeSize(const vector<int>& shape) {
+  uint64_t size = 0;
+  for (int i = 0; i < shape.size(); ++i) {
+    size += CodedOutputStream::VarintSize64(shape[i]);
+  }
+  return size;
+}
+
+template <typename Dtype>
+static uint64_t BlobProtoSize(const Blob<Dtype>& blob, bool write_diff) {
+  const uint64_t dims_size = BlobShapeSize(blob.shape());
+  const uint64_t shape_size = dims_size ? ProtoStreamWriter::
+      LengthDelimitedSize(BlobShape::kDimFieldNumber, dims_size) : 0;
+  uint64_t size = ProtoStreamWriter::LengthDelimitedSize(
+      BlobProto::kShapeFieldNumber, shape_size);
+  const uint64_t data_size = blob.count() * sizeof(Dtype);
+  if (data_size) {
+    size += ProtoStreamWriter::LengthDelimitedSize(
+        BlobDataField<Dtype>(false), data_size);
+    if (write_diff) {
+      size += ProtoStreamWriter::LengthDelimitedSize(
+          BlobDataField<Dtype>(true), data_size);
+    }
+  }
+  return size;
+}
+
+template <typename Dtype>
+void ProtoStreamWriter::WriteBlob(int field_number, const Blob<Dtype>& blob,
+    bool write_diff) {
+  WriteLengthDelimited(field_number, BlobProtoSize(blob, write_diff));
+  const vector<int>& shape = blob.shape();
+  const uint64_t dims_size = BlobShapeSize(shape);
+  WriteLengthDelimited(BlobProto::kShapeFieldNumber, dims_size ?
+      LengthDelimitedSize(BlobShape::kDimFieldNumber, dims_size) : 0);
+  if (dims_size) {
+    WriteLengthDelimited(BlobShape::kDimFieldNumber, dims_size);
+    for (int i = 0; i < shape.size(); ++i) {
+      coded()->WriteVarint64(shape[i]);
+    }
+  }
+  const uint64_t data_size = blob.count() * sizeof(Dtype);
+  if (data_size) {
+    WriteLengthDelimited(BlobDataField<Dtype>(false), data_size);
+    WriteRaw(blob.cpu_data(), data_size);
+    if (write_diff) {
+      WriteLengthDelimited(BlobDataField<Dtype>(true), data_size);
+      WriteRaw(blob.cpu_diff(), data_size);
+    }
+  }
+}
+
+void ProtoStreamWriter::Close() {
+  CHECK(!coded_output_->HadError()) << "Error writing " << filename_;
+  coded_output_.reset();
+  CHECK(raw_output_->Close()) << "Error writing " << filename_;
+  raw_output_.reset();
+}
+
+uint64_t ProtoStreamWriter::FieldsSize(const Message& message) {
+#if GOOGLE_PROTOBUF_VERSION >= 3000000
+  return message.ByteSizeLong();
+#else
+  return message.ByteSize();
+#endif
+}
+
+uint64_t ProtoStreamWriter::LengthDelimitedSize(int field_number,
+    uint64_t size) {
+  return CodedOutputStream::VarintSize32(WireFormatLite::MakeTag(
+      field_number, WireFormatLite::WIRETYPE_LENGTH_DELIMITED)) +
+      CodedOutputStream::VarintSize64(size) + size;
+}
+
+template <typename Dtype>
+uint64_t ProtoStreamWriter::BlobSize(int field_number, const Blob<Dtype>& blob,
+    bool write_diff) {
+  return LengthDelimitedSize(field_number, BlobProtoSize(blob, write_diff));
+}
+
+ProtoStreamReader::ProtoStreamReader(const string& filename)
+    : filename_(filename), consumed_(0), tag_(0) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd_, -1) << "File not found: " << filename;
+  raw_input_.reset(new FileInputStream(fd_));
+  coded_input_.reset(new CodedInputStream(raw_input_.get()));
+}
+
+ProtoStreamReader::~ProtoStreamReader() {
+  coded_input_.reset();
+  raw_input_.reset();
+  close(fd_);
+}
+
+CodedInputStream* ProtoStreamReader::coded() {
+  if (coded_input_->CurrentPosition() >= kStreamRefreshBytes) {
+    consumed_ += coded_input_->CurrentPosition();
+    // The old stream hands its unread buffer back to raw_input_ on deletion.
+    coded_input_.reset();
+    coded_input_.reset(new CodedInputStream(raw_input_.get()));
+  }
+  return coded_input_.get();
+}
+
+int64_t ProtoStreamReader::position() const {
+  return consumed_ + coded_input_->CurrentPosition();
+}
+
+bool ProtoStreamReader::NextField(int64_t end, int* field_number) {
+  if (end >= 0 && position() >= end) {
+    CHECK_EQ(position(), end) << "Failed to parse " << filename_;
+    return false;
+  }
+  tag_ = coded()->ReadTag();
+  if (tag_ == 0) {
+    CHECK_LT(end, 0) << "Failed to parse " << filename_;
+    return false;
+  }
+  *field_number = WireFormatLite::GetTagFieldNumber(tag_);
+  return true;
+}
+
+void ProtoStreamReader::Skip(uint64_t size) {
+  while (size > 0) {
+    const int chunk = std::min<uint64_t>(size, kStreamChunkBytes);
+    CHECK(coded()->Skip(chunk)) << "Failed to parse " << filename_;
+    size -= chunk;
+  }
+}
+
+void ProtoStreamReader::SkipField() {
+  if (WireFormatLite::GetTagWireType(tag_) ==
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    Skip(ReadMessageEnd() - position());
+  } else {
+    CHECK(WireFormatLite::SkipField(coded(), tag_))
+        << "Failed to parse " << filename_;
+  }
+}
+
+int ProtoStreamReader::ReadInt32() {
+  uint32_t value;
+  CHECK(coded()->ReadVarint32(&value)) << "Failed to parse " << filename_;
+  return static_cast<int>(value);
+}
+
+string ProtoStreamReader::ReadString() {
+  string value;
+  CHECK(WireFormatLite::ReadString(coded(), &value))
+      << "Failed to parse " << filename_;
+  return value;
+}
+
+int64_t ProtoStreamReader::ReadMessageEnd() {
+  uint64_t size;
+  CHECK(coded()->ReadVarint64(&size)) << "Failed to parse " << filename_;
+  return position() + size;
+}
+
+// Reads the packed (or unpacked) repeated Stype field at the current tag into
+// values, starting at values[*count]. Values past capacity are skipped.
+template <typename Stype, typename Dtype>
+void ProtoStreamReader::ReadValues(int64_t capacity, int64_t* count,
+    Dtype* values) {
+  if (WireFormatLite::GetTagWireType(tag_) !=
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    Stype value;
+    CHECK(coded()->ReadRaw(&value, sizeof(value)))
+        << "Failed to parse " << filename_;
+    if (*count < capacity) {
+      values[*count] = value;
+    }
+    ++*count;
+    return;
+  }
+  const int64_t size = ReadMessageEnd() - position();
+  CHECK_EQ(size % sizeof(Stype), 0) << "Failed to parse " << filename_;
+  const int64_t num = size / sizeof(Stype);
+  if (*count + num > capacity) {
+    Skip(size);
+    *count += num;
+    return;
+  }
+  Dtype* dst = values + *count;
+  *count += num;
+  const int64_t chunk_values = kStreamChunkBytes / sizeof(Stype);
+  vector<Stype> buffer;
+  for (int64_t offset = 0; offset < num; offset += chunk_values) {
+    const int64_t n = std::min(num - offset, chunk_values);
+    if (sizeof(Stype) == sizeof(Dtype)) {
+      CHECK(coded()->ReadRaw(dst + offset, n * sizeof(Stype)))
+          << "Failed to parse " << filename_;
+    } else {
+      buffer.resize(n);
+      CHECK(coded()->ReadRaw(&buffer[0], n * sizeof(Stype)))
+          << "Failed to parse " << filename_;
+      std::copy(buffer.begin(), buffer.end(), dst + offset);
+    }
+  }
+}
+
+template <typename Dtype>
+bool ProtoStreamReader::ReadBlob(Blob<Dtype>* blob, BlobProto* header) {
+  const int64_t end = ReadMessageEnd();
+  const int64_t count = blob->count();
+  int64_t data_count = 0;
+  int64_t diff_count = 0;
+  header->Clear();
+  int field;
+  while (NextField(end, &field)) {
+    switch (field) {
+    case BlobProto::kNumFieldNumber:
+      header->set_num(ReadInt32());
+      break;
+    case BlobProto::kChannelsFieldNumber:
+      header->set_channels(ReadInt32());
+      break;
+    case BlobProto::kHeightFieldNumber:
+      header->set_height(ReadInt32());
+      break;
+    case BlobProto::kWidthFieldNumber:
+      header->set_width(ReadInt32());
+      break;
+    case BlobProto::kShapeFieldNumber: {
+      BlobShape* shape = header->mutable_shape();
+      const int64_t shape_end = ReadMessageEnd();
+      while (NextField(shape_end, &field)) {
+        if (field != BlobShape::kDimFieldNumber) {
+          SkipField();
+        } else if (WireFormatLite::GetTagWireType(tag_) ==
+            WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+          const int64_t dims_end = ReadMessageEnd();
+          while (position() < dims_end) {
+            uint64_t dim;
+            CHECK(coded()->ReadVarint64(&dim))
+                << "Failed to parse " << filename_;
+            shape->add_dim(dim);
+          }
+        } else {
+          uint64_t dim;
+          CHECK(coded()->ReadVarint64(&dim)) << "Failed to parse " << filename_;
+          shape->add_dim(dim);
+        }
+      }
+      break;
+    }
+    case BlobProto::kDataFieldNumber:
+      ReadValues<float>(count, &data_count, blob->mutable_cpu_data());
+      break;
+    case BlobProto::kDoubleDataFieldNumber:
+      ReadValues<double>(count, &data_count, blob->mutable_cpu_data());
+      break;
+    case BlobProto::kDiffFieldNumber:
+      ReadValues<float>(count, &diff_count, blob->mutable_cpu_diff());
+      break;
+    case BlobProto::kDoubleDiffFieldNumber:
+      ReadValues<double>(count, &diff_count, blob->mutable_cpu_diff());
+      break;
+    default:
+      SkipField();
+    }
+  }
+  return data_count == count && (diff_count == 0 || diff_count == count);
+}
+
+template void ProtoStreamWriter::WriteBlob<float>(int field_number,
+    const Blob<float>& blob, bool write_diff);
+template void ProtoStreamWriter::WriteBlob<double>(int field_number,
+    const Blob<double>& blob, bool write_diff);
+template uint64_t ProtoStreamWriter::BlobSize<float>(int field_number,
+    const Blob<float>& blob, bool write_diff);
+template uint64_t ProtoStreamWriter::BlobSize<double>(int field_number,
+    const Blob<double>& blob, bool write_diff);
+template bool ProtoStreamReader::ReadBlob<float>(Blob<float>* blob,
+    BlobProto* header);
+template bool ProtoStreamReader::ReadBlob<double>(Blob<double>* blob,
+    BlobProto* header);
+
+}  // namespace caffe
@@ -0,0 +1,63 @@
+#include <boost/thread.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "caffe/util/snapshot_writer.hpp"
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+SnapshotWriter::SnapshotWriter()
+    : pending_(), done_(), num_pending_(0) {
+  StartInternalThread();
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  Wait();
+  StopInternalThread();
+}
+
+void SnapshotWriter::Write(const string& filename, const FileWriter& writer) {
+  shared_ptr<Task> task(new Task());
+  task->filename = filename;
+  task->writer = writer;
+  ++num_pending_;
+  pending_.push(task);
+}
+
+void SnapshotWriter::Wait() {
+  for (; num_pending_ > 0; --num_pending_) {
+    shared_ptr<Task> task = done_.pop("Waiting for snapshot to be written");
+    LOG(INFO) << "Snapshot " << task->filename << " written";
+  }
+}
+
+void SnapshotWriter::InternalThreadEntry() {
+  Tracer::SetThreadName("SnapshotWriter");
+  try {
+    while (!must_stop()) {
+      shared_ptr<Task> task = pending_.pop();
+      TraceSpan trace("Write " + task->filename, "snapshot");
+      const string temp_filename = task->filename + ".tmp";
+      task->writer(temp_filename);
+      SyncAndRenameFile(temp_filename, task->filename);
+      done_.push(task);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+void SyncAndRenameFile(const string& filename, const string& new_filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  CHECK_EQ(fsync(fd), 0) << "Couldn't sync " << filename << " to disk";
+  close(fd);
+  CHECK_EQ(std::rename(filename.c_str(), new_filename.c_str()), 0)
+      << "Couldn't rename " << filename << " to " << new_filename;
+}
+
+}  // namespace caffe
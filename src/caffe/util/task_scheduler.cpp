@@ -0,0 +1,109 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <vector>
+
+#include "caffe/util/task_scheduler.hpp"
+
+namespace caffe {
+
+class TaskScheduler::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+TaskScheduler::TaskScheduler(int num_threads)
+    : sync_(new sync()), successors_(NULL), on_caller_(NULL), task_(NULL),
+      num_pending_(0), stop_(false) {
+  CHECK_GE(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(boost::bind(&TaskScheduler::WorkerEntry, this))));
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->condition_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void TaskScheduler::Run(const vector<vector<int> >& successors,
+    const vector<bool>& on_caller, const Task& task) {
+  CHECK_EQ(successors.size(), on_caller.size());
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  CHECK(task_ == NULL) << "TaskScheduler::Run is not reentrant.";
+  successors_ = &successors;
+  on_caller_ = &on_caller;
+  task_ = &task;
+  num_predecessors_.assign(successors.size(), 0);
+  for (int i = 0; i < successors.size(); ++i) {
+    for (int j = 0; j < successors[i].size(); ++j) {
+      ++num_predecessors_[successors[i][j]];
+    }
+  }
+  num_pending_ = successors.size();
+  for (int i = 0; i < successors.size(); ++i) {
+    if (num_predecessors_[i] == 0) { Queue(i); }
+  }
+  sync_->condition_.notify_all();
+  while (num_pending_ > 0) {
+    std::deque<int>* queue = !caller_ready_.empty() ? &caller_ready_ :
+        (!ready_.empty() ? &ready_ : NULL);
+    if (queue == NULL) {
+      sync_->condition_.wait(lock);
+      continue;
+    }
+    const int task_id = queue->front();
+    queue->pop_front();
+    lock.unlock();
+    task(task_id);
+    lock.lock();
+    Finish(task_id);
+  }
+  successors_ = NULL;
+  on_caller_ = NULL;
+  task_ = NULL;
+}
+
+void TaskScheduler::WorkerEntry() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (!stop_ && ready_.empty()) {
+      sync_->condition_.wait(lock);
+    }
+    if (stop_) { return; }
+    const int task_id = ready_.front();
+    ready_.pop_front();
+    const Task* task = task_;
+    lock.unlock();
+    (*task)(task_id);
+    lock.lock();
+    Finish(task_id);
+  }
+}
+
+void TaskScheduler::Finish(int task_id) {
+  const vector<int>& successors = (*successors_)[task_id];
+  for (int i = 0; i < successors.size(); ++i) {
+    if (--num_predecessors_[successors[i]] == 0) { Queue(successors[i]); }
+  }
+  --num_pending_;
+  sync_->condition_.notify_all();
+}
+
+void TaskScheduler::Queue(int task_id) {
+  if ((*on_caller_)[task_id]) {
+    caller_ready_.push_back(task_id);
+  } else {
+    ready_.push_back(task_id);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,130 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/format.hpp"
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+bool Tracer::enabled_ = false;
+
+namespace {
+
+struct Event {
+  string name;
+  const char* category;
+  int64_t start;
+  int64_t end;
+};
+
+// The events of one thread. The mutex is only contended while the trace is
+// started or written.
+struct ThreadBuffer {
+  boost::mutex mutex;
+  int id;
+  string name;
+  vector<Event> events;
+};
+
+// The buffers outlive their threads, so that their events are written.
+struct Registry {
+  Registry()
+      : local(&Registry::Keep),
+        start(boost::posix_time::microsec_clock::universal_time()) {}
+  static void Keep(ThreadBuffer* buffer) {}
+
+  boost::mutex mutex;
+  vector<shared_ptr<ThreadBuffer> > buffers;
+  boost::thread_specific_ptr<ThreadBuffer> local;
+  boost::posix_time::ptime start;
+};
+
+Registry& registry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadBuffer* LocalBuffer() {
+  Registry& r = registry();
+  ThreadBuffer* buffer = r.local.get();
+  if (!buffer) {
+    boost::mutex::scoped_lock lock(r.mutex);
+    r.buffers.push_back(shared_ptr<ThreadBuffer>(new ThreadBuffer()));
+    buffer = r.buffers.back().get();
+    buffer->id = r.buffers.size();
+    r.local.reset(buffer);
+  }
+  return buffer;
+}
+
+}  // namespace
+
+void Tracer::Start() {
+  Registry& r = registry();
+  boost::mutex::scoped_lock lock(r.mutex);
+  for (int i = 0; i < r.buffers.size(); ++i) {
+    boost::mutex::scoped_lock buffer_lock(r.buffers[i]->mutex);
+    r.buffers[i]->events.clear();
+  }
+  r.start = boost::posix_time::microsec_clock::universal_time();
+  enabled_ = true;
+}
+
+void Tracer::Stop() {
+  enabled_ = false;
+}
+
+void Tracer::Write(const string& filename) {
+  std::ofstream out(filename.c_str());
+  CHECK(out.good()) << "Failed to open trace file " << filename;
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  Registry& r = registry();
+  boost::mutex::scoped_lock lock(r.mutex);
+  bool first = true;
+  for (int i = 0; i < r.buffers.size(); ++i) {
+    ThreadBuffer* buffer = r.buffers[i].get();
+    boost::mutex::scoped_lock buffer_lock(buffer->mutex);
+    if (!buffer->name.empty()) {
+      out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", "
+          << "\"ph\": \"M\", \"pid\": 0, \"tid\": " << buffer->id
+          << ", \"args\": {\"name\": " << format_json_string(buffer->name)
+          << "}}";
+      first = false;
+    }
+    for (int j = 0; j < buffer->events.size(); ++j) {
+      const Event& event = buffer->events[j];
+      out << (first ? "\n" : ",\n") << "{\"name\": "
+          << format_json_string(event.name) << ", \"cat\": \""
+          << event.category << "\", \"ph\": \"X\", \"ts\": " << event.start
+          << ", \"dur\": " << event.end - event.start
+          << ", \"pid\": 0, \"tid\": " << buffer->id << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  CHECK(out.good()) << "Failed to write trace file " << filename;
+}
+
+void Tracer::SetThreadName(const string& name) {
+  ThreadBuffer* buffer = LocalBuffer();
+  boost::mutex::scoped_lock lock(buffer->mutex);
+  buffer->name = name;
+}
+
+int64_t Tracer::Now() {
+  return (boost::posix_time::microsec_clock::universal_time() -
+      registry().start).total_microseconds();
+}
+
+void Tracer::Record(const string& name, const char* category,
+    int64_t start, int64_t end) {
+  ThreadBuffer* buffer = LocalBuffer();
+  boost::mutex::scoped_lock lock(buffer->mutex);
+  Event event = {name, category, start, end};
+  buffer->events.push_back(event);
+}
+
+}  // namespace caffe
@@ -0,0 +1,312 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "caffe/util/cpu_features.hpp"
+#include "caffe/util/vector_math.hpp"
+
+#ifdef CAFFE_MULTI_ISA
+#define CAFFE_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define CAFFE_ALWAYS_INLINE inline
+#endif
+// GCC keeps the selects below as branches, which stop the loops from
+// vectorizing, as long as it must preserve floating point exceptions.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("no-trapping-math")
+#endif
+
+namespace caffe {
+
+namespace {
+
+// Scalar versions of the functions, written without branches or calls so
+// that the loops over them vectorize. They are inlined into each of the
+// per-instruction-set loops below.
+
+CAFFE_ALWAYS_INLINE int32_t float_bits(float x) {
+  int32_t i;
+  memcpy(&i, &x, sizeof(i));  // NOLINT(caffe/alt_fn)
+  return i;
+}
+
+CAFFE_ALWAYS_INLINE float bits_float(int32_t i) {
+  float x;
+  memcpy(&x, &i, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return x;
+}
+
+// In place of std::min and std::max, which are compiled before the pragma
+// above and so keep their branches.
+template <typename Dtype>
+CAFFE_ALWAYS_INLINE Dtype clamp(Dtype x, Dtype lo, Dtype hi) {
+  x = x < lo ? lo : x;
+  return x > hi ? hi : x;
+}
+
+CAFFE_ALWAYS_INLINE int64_t double_bits(double x) {
+  int64_t i;
+  memcpy(&i, &x, sizeof(i));  // NOLINT(caffe/alt_fn)
+  return i;
+}
+
+CAFFE_ALWAYS_INLINE double bits_double(int64_t i) {
+  double x;
+  memcpy(&x, &i, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return x;
+}
+
+const float kFloatInf = std::numeric_limits<float>::infinity();
+const float kFloatNaN = std::numeric_limits<float>::quiet_NaN();
+
+// exp(x) = 2^n * exp(r) with r = x - n * ln(2) in [-ln(2) / 2, ln(2) / 2],
+// with the polynomial of Cephes' expf. 2^n is applied in two halves so that
+// results near overflow and in the denormal range are still right.
+CAFFE_ALWAYS_INLINE float exp_float(float x) {
+  // Rounds to nearest for |x| < 2^22, unlike a call to rint or floor this
+  // vectorizes without SSE4.1.
+  const float kShifter = 12582912.f;  // 1.5 * 2^23
+  const float t = clamp(x, -104.f, 89.f);
+  const float n = (t * 1.44269504088896341f + kShifter) - kShifter;
+  float r = t - n * 0.693359375f;
+  r = r - n * -2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.f;
+  const int32_t k = static_cast<int32_t>(n);
+  const int32_t k1 = k >> 1;
+  const int32_t k2 = k - k1;
+  const float y = p * bits_float((k1 + 127) << 23) *
+      bits_float((k2 + 127) << 23);
+  return x != x ? x : y;
+}
+
+// log(x) = e * ln(2) + log(m) with m in [sqrt(2) / 2, sqrt(2)), with the
+// polynomial of Cephes' logf.
+CAFFE_ALWAYS_INLINE float log_float(float x) {
+  // Normalize denormals first.
+  const bool denormal = x < std::numeric_limits<float>::min();
+  const int32_t i = float_bits(denormal ? x * 33554432.f : x);  // 2^25
+  int32_t e = ((i >> 23) & 0xff) - (denormal ? 151 : 126);
+  float m = bits_float((i & 0x007fffff) | 0x3f000000);  // in [0.5, 1)
+  const bool low = m < 0.707106781186547524f;
+  e = low ? e - 1 : e;
+  m = low ? m + m - 1.f : m - 1.f;
+  const float z = m * m;
+  float p = 7.0376836292e-2f;
+  p = p * m - 1.1514610310e-1f;
+  p = p * m + 1.1676998740e-1f;
+  p = p * m - 1.2420140846e-1f;
+  p = p * m + 1.4249322787e-1f;
+  p = p * m - 1.6668057665e-1f;
+  p = p * m + 2.0000714765e-1f;
+  p = p * m - 2.4999993993e-1f;
+  p = p * m + 3.3333331174e-1f;
+  const float fe = static_cast<float>(e);
+  float y = p * m * z;
+  y += fe * -2.12194440e-4f;
+  y += z * -0.5f;
+  y = m + y;
+  y += fe * 0.693359375f;
+  y = x == kFloatInf ? x : y;
+  return x > 0.f ? y : (x == 0.f ? -kFloatInf : kFloatNaN);
+}
+
+// tanh by the odd polynomial of Cephes' tanhf near 0, and from exp(2|x|)
+// further out, where there is no cancellation.
+CAFFE_ALWAYS_INLINE float tanh_float(float x) {
+  const float ax = x < 0.f ? -x : x;
+  const float z = x * x;
+  float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  // Keeps the sign of -0.
+  const float near = x == 0.f ? x : p * z * x + x;
+  float far = 1.f - 2.f / (exp_float(ax + ax) + 1.f);
+  far = x < 0.f ? -far : far;
+  return ax < 0.625f ? near : far;
+}
+
+// From exp(-|x|), which does not overflow, so that the results for large
+// negative x are denormal rather than 0.
+CAFFE_ALWAYS_INLINE float sigmoid_float(float x) {
+  const float e = exp_float(x < 0.f ? x : -x);
+  return (x < 0.f ? e : 1.f) / (1.f + e);
+}
+
+// Double precision log and exp, with just enough terms for pow to round
+// correctly to float nearly always. log(x) = e * ln(2) + 2 atanh(s) with
+// s = (m - 1) / (m + 1), for x > 0 normal.
+CAFFE_ALWAYS_INLINE double log_double(double x) {
+  const int64_t i = double_bits(x);
+  // The exponent, converted to double through the bits of 2^52 + e since
+  // int64 to double conversions do not vectorize before AVX-512DQ.
+  const double kTwo52 = 4503599627370496.0;
+  double e = bits_double(0x4330000000000000LL | ((i >> 52) & 0x7ff)) -
+      kTwo52 - 1022.;
+  double m = bits_double((i & 0x000fffffffffffffLL) |
+                         0x3fe0000000000000LL);  // in [0.5, 1)
+  const bool low = m < 0.70710678118654752;
+  e = low ? e - 1. : e;
+  m = low ? m + m : m;
+  const double s = (m - 1.) / (m + 1.);
+  const double s2 = s * s;
+  double p = 1. / 15;
+  p = p * s2 + 1. / 13;
+  p = p * s2 + 1. / 11;
+  p = p * s2 + 1. / 9;
+  p = p * s2 + 1. / 7;
+  p = p * s2 + 1. / 5;
+  p = p * s2 + 1. / 3;
+  return e * 0.69314718055994530942 + (s + s) + (s + s) * s2 * p;
+}
+
+// exp(t) = 2^n * exp(r) with the Taylor series of exp(r), clamped to the
+// range of float results.
+CAFFE_ALWAYS_INLINE double exp_double(double t) {
+  const double kShifter = 6755399441055744.0;  // 1.5 * 2^52
+  t = clamp(t, -120., 100.);
+  const double shifted = t * 1.4426950408889634074 + kShifter;
+  const double n = shifted - kShifter;
+  double r = t - n * 6.93147180369123816490e-01;
+  r = r - n * 1.90821492927058770002e-10;
+  double p = 1. / 3628800;
+  p = p * r + 1. / 362880;
+  p = p * r + 1. / 40320;
+  p = p * r + 1. / 5040;
+  p = p * r + 1. / 720;
+  p = p * r + 1. / 120;
+  p = p * r + 1. / 24;
+  p = p * r + 1. / 6;
+  p = p * r + 0.5;
+  p = p * r * r + r + 1.;
+  // The low bits of shifted hold n.
+  const int64_t k = double_bits(shifted) - double_bits(kShifter);
+  return p * bits_double((k + 1023) << 52);
+}
+
+// pow for b other than 0, where b_integer and b_odd describe b, for negative
+// x.
+CAFFE_ALWAYS_INLINE float pow_float(float x, double b, bool b_integer,
+    bool b_odd) {
+  const double ax = static_cast<double>(x < 0.f ? -x : x);
+  // log_double is only right for x > 0 finite, and exp_double clamps.
+  double l = log_double(ax);
+  l = ax == 0. ? -1e3 : l;
+  l = ax > 3.4028234663852886e38 ? 1e3 : l;
+  float y = static_cast<float>(exp_double(b * l));
+  y = (float_bits(x) < 0) & b_odd ? -y : y;
+  y = (x < 0.f) & !b_integer ? kFloatNaN : y;
+  return x != x ? x : y;
+}
+
+struct Kernels {
+  void (*exp)(const int n, const float* a, float* y);
+  void (*log)(const int n, const float* a, float* y);
+  void (*powx)(const int n, const float* a, const double b,
+      const bool b_integer, const bool b_odd, float* y);
+  void (*tanh)(const int n, const float* a, float* y);
+  void (*sigmoid)(const int n, const float* a, float* y);
+};
+
+#define DEFINE_VECTOR_MATH_KERNELS(isa, attributes) \
+  attributes void exp_##isa(const int n, const float* a, float* y) { \
+    for (int i = 0; i < n; ++i) { y[i] = exp_float(a[i]); } \
+  } \
+  attributes void log_##isa(const int n, const float* a, float* y) { \
+    for (int i = 0; i < n; ++i) { y[i] = log_float(a[i]); } \
+  } \
+  attributes void tanh_##isa(const int n, const float* a, float* y) { \
+    for (int i = 0; i < n; ++i) { y[i] = tanh_float(a[i]); } \
+  } \
+  attributes void sigmoid_##isa(const int n, const float* a, float* y) { \
+    for (int i = 0; i < n; ++i) { y[i] = sigmoid_float(a[i]); } \
+  }
+
+// pow works in double precision, which only pays off with 4 or more doubles
+// per vector; the generic and SSE4 builds call libm instead.
+#define DEFINE_VECTOR_MATH_POWX(isa, attributes) \
+  attributes void powx_##isa(const int n, const float* a, const double b, \
+      const bool b_integer, const bool b_odd, float* y) { \
+    for (int i = 0; i < n; ++i) { \
+      y[i] = pow_float(a[i], b, b_integer, b_odd); \
+    } \
+  }
+
+void powx_generic(const int n, const float* a, const double b,
+    const bool b_integer, const bool b_odd, float* y) {
+  const float b_float = static_cast<float>(b);
+  for (int i = 0; i < n; ++i) { y[i] = std::pow(a[i], b_float); }
+}
+
+DEFINE_VECTOR_MATH_KERNELS(generic, );  // NOLINT(whitespace/parens)
+#ifdef CAFFE_MULTI_ISA
+DEFINE_VECTOR_MATH_KERNELS(sse4, CAFFE_TARGET_SSE4);
+DEFINE_VECTOR_MATH_KERNELS(avx2, CAFFE_TARGET_AVX2);
+DEFINE_VECTOR_MATH_POWX(avx2, CAFFE_TARGET_AVX2);
+DEFINE_VECTOR_MATH_KERNELS(avx512, CAFFE_TARGET_AVX512);
+DEFINE_VECTOR_MATH_POWX(avx512, CAFFE_TARGET_AVX512);
+#endif
+
+// Indexed by CPUISA.
+const Kernels kernels_by_isa[] = {
+  {exp_generic, log_generic, powx_generic, tanh_generic, sigmoid_generic},
+#ifdef CAFFE_MULTI_ISA
+  {exp_sse4, log_sse4, powx_generic, tanh_sse4, sigmoid_sse4},
+  {exp_avx2, log_avx2, powx_avx2, tanh_avx2, sigmoid_avx2},
+  {exp_avx512, log_avx512, powx_avx512, tanh_avx512, sigmoid_avx512},
+#endif
+};
+
+const Kernels& kernels() {
+#ifdef CAFFE_MULTI_ISA
+  return kernels_by_isa[cpu_isa()];
+#else
+  return kernels_by_isa[CPU_ISA_GENERIC];
+#endif
+}
+
+}  // namespace
+
+void vector_exp(const int n, const float* a, float* y) {
+  kernels().exp(n, a, y);
+}
+
+void vector_log(const int n, const float* a, float* y) {
+  kernels().log(n, a, y);
+}
+
+void vector_powx(const int n, const float* a, const float b, float* y) {
+  // The exact special cases.
+  if (b == 0.f) {
+    std::fill(y, y + n, 1.f);
+  } else if (b == 1.f) {
+    std::copy(a, a + n, y);
+  } else if (b == 2.f) {
+    for (int i = 0; i < n; ++i) { y[i] = a[i] * a[i]; }
+  } else if (b == -1.f) {
+    for (int i = 0; i < n; ++i) { y[i] = 1.f / a[i]; }
+  } else {
+    const bool b_integer = std::floor(b) == b;
+    const bool b_odd = b_integer && std::fabs(std::fmod(b, 2.f)) == 1.f;
+    kernels().powx(n, a, b, b_integer, b_odd, y);
+  }
+}
+
+void vector_tanh(const int n, const float* a, float* y) {
+  kernels().tanh(n, a, y);
+}
+
+void vector_sigmoid(const int n, const float* a, float* y) {
+  kernels().sigmoid(n, a, y);
+}
+
+}  // namespace caffe
@@ -0,0 +1,512 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(filter, "",
+    "Optional; only run the benchmarks whose name contains this string.");
+DEFINE_bool(list, false,
+    "Optional; list the benchmarks instead of running them.");
+DEFINE_double(min_time, 0.5,
+    "The minimum number of seconds to time each benchmark for.");
+DEFINE_int32(min_iterations, 5,
+    "The minimum number of timed runs of each benchmark.");
+DEFINE_string(output, "",
+    "Optional; write the results to this CSV file, e.g. to use as a "
+    "baseline later.");
+DEFINE_string(baseline, "",
+    "Optional; compare the median times against the results of an earlier "
+    "run in this CSV file, and exit with status 1 on any regression.");
+DEFINE_double(tolerance, 0.1,
+    "The fraction by which a median time may exceed its baseline before it "
+    "is reported as a regression.");
+
+namespace {
+
+// A micro-benchmark. SetUp is only called when the benchmark is selected,
+// then Run is timed repeatedly after one warm-up run.
+class Benchmark {
+ public:
+  virtual ~Benchmark() {}
+  const string& name() const { return name_; }
+  virtual void SetUp() {}
+  virtual void Run() = 0;
+
+ protected:
+  string name_;
+};
+
+string Dims(int a, int b, int c = 0, int d = 0) {
+  std::ostringstream dims;
+  dims << a << "x" << b;
+  if (c > 0) { dims << "x" << c; }
+  if (d > 0) { dims << "x" << d; }
+  return dims.str();
+}
+
+void FillGaussian(vector<float>* values) {
+  caffe_rng_gaussian<float>(values->size(), 0, 1, &(*values)[0]);
+}
+
+class GemmBenchmark : public Benchmark {
+ public:
+  GemmBenchmark(int M, int N, int K) : M_(M), N_(N), K_(K) {
+    name_ = "gemm/" + Dims(M, N, K);
+  }
+  virtual void SetUp() {
+    A_.resize(M_ * K_);
+    B_.resize(K_ * N_);
+    C_.resize(M_ * N_);
+    FillGaussian(&A_);
+    FillGaussian(&B_);
+  }
+  virtual void Run() {
+    caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, M_, N_, K_, 1.,
+        &A_[0], &B_[0], 0., &C_[0]);
+  }
+
+ private:
+  int M_, N_, K_;
+  vector<float> A_, B_, C_;
+};
+
+class AxpyBenchmark : public Benchmark {
+ public:
+  explicit AxpyBenchmark(int n) : n_(n) {
+    std::ostringstream name;
+    name << "axpy/" << n;
+    name_ = name.str();
+  }
+  virtual void SetUp() {
+    x_.resize(n_);
+    y_.resize(n_);
+    FillGaussian(&x_);
+    FillGaussian(&y_);
+  }
+  virtual void Run() { caffe_axpy<float>(n_, 0.5, &x_[0], &y_[0]); }
+
+ private:
+  int n_;
+  vector<float> x_, y_;
+};
+
+class ExpBenchmark : public Benchmark {
+ public:
+  explicit ExpBenchmark(int n) : n_(n) {
+    std::ostringstream name;
+    name << "exp/" << n;
+    name_ = name.str();
+  }
+  virtual void SetUp() {
+    x_.resize(n_);
+    y_.resize(n_);
+    FillGaussian(&x_);
+  }
+  virtual void Run() { caffe_exp<float>(n_, &x_[0], &y_[0]); }
+
+ private:
+  int n_;
+  vector<float> x_, y_;
+};
+
+// Times im2col_cpu, or col2im_cpu for the reverse, of a square image.
+class Im2colBenchmark : public Benchmark {
+ public:
+  Im2colBenchmark(int channels, int size, int kernel, int pad, int stride,
+      bool reverse)
+      : channels_(channels), size_(size), kernel_(kernel), pad_(pad),
+        stride_(stride), reverse_(reverse) {
+    std::ostringstream name;
+    name << (reverse ? "col2im/" : "im2col/") << Dims(channels, size, size)
+         << "_k" << kernel << "_p" << pad << "_s" << stride;
+    name_ = name.str();
+  }
+  virtual void SetUp() {
+    const int out_size = (size_ + 2 * pad_ - kernel_) / stride_ + 1;
+    im_.resize(channels_ * size_ * size_);
+    col_.resize(channels_ * kernel_ * kernel_ * out_size * out_size);
+    FillGaussian(&im_);
+    FillGaussian(&col_);
+  }
+  virtual void Run() {
+    if (reverse_) {
+      col2im_cpu(&col_[0], channels_, size_, size_, kernel_, kernel_, pad_,
+          pad_, stride_, stride_, 1, 1, &im_[0]);
+    } else {
+      im2col_cpu(&im_[0], channels_, size_, size_, kernel_, kernel_, pad_,
+          pad_, stride_, stride_, 1, 1, &col_[0]);
+    }
+  }
+
+ private:
+  int channels_, size_, kernel_, pad_, stride_;
+  bool reverse_;
+  vector<float> im_, col_;
+};
+
+// Times the training-time transformation (random crop, mirror and mean
+// subtraction) of an ImageNet-sized datum.
+class TransformBenchmark : public Benchmark {
+ public:
+  TransformBenchmark() { name_ = "transform/3x256x256_crop227"; }
+  virtual void SetUp() {
+    TransformationParameter param;
+    param.set_crop_size(227);
+    param.set_mirror(true);
+    param.add_mean_value(104);
+    param.add_mean_value(117);
+    param.add_mean_value(123);
+    transformer_.reset(new DataTransformer<float>(param, TRAIN));
+    transformer_->InitRand();
+    datum_.set_channels(3);
+    datum_.set_height(256);
+    datum_.set_width(256);
+    string data(3 * 256 * 256, 0);
+    for (int i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<char>(caffe_rng_rand() % 256);
+    }
+    datum_.set_data(data);
+    blob_.Reshape(1, 3, 227, 227);
+  }
+  virtual void Run() { transformer_->Transform(datum_, &blob_); }
+
+ private:
+  shared_ptr<DataTransformer<float> > transformer_;
+  Datum datum_;
+  Blob<float> blob_;
+};
+
+// Times passing items through a BlockingQueue, either on one thread or
+// from a producer thread to the consumer.
+class QueueBenchmark : public Benchmark {
+ public:
+  explicit QueueBenchmark(bool threaded) : threaded_(threaded) {
+    std::ostringstream name;
+    name << "blocking_queue/" << (threaded ? "producer_consumer/" : "push_pop/")
+         << kItems;
+    name_ = name.str();
+  }
+  virtual void Run() {
+    if (threaded_) {
+      boost::thread producer(&QueueBenchmark::Produce, this);
+      for (int i = 0; i < kItems; ++i) {
+        queue_.pop();
+      }
+      producer.join();
+    } else {
+      for (int i = 0; i < kItems; ++i) {
+        queue_.push(&datum_);
+        queue_.pop();
+      }
+    }
+  }
+
+ private:
+  static const int kItems = 10000;
+
+  void Produce() {
+    for (int i = 0; i < kItems; ++i) {
+      queue_.push(&datum_);
+    }
+  }
+
+  bool threaded_;
+  Datum datum_;
+  BlockingQueue<Datum*> queue_;
+};
+
+// Times the CPU forward or backward pass of a layer on Gaussian inputs.
+class LayerBenchmark : public Benchmark {
+ public:
+  LayerBenchmark(const string& label, const string& param,
+      const vector<int>& shape, int num_bottoms, bool backward)
+      : label_(label), param_(param), shape_(shape), num_bottoms_(num_bottoms),
+        backward_(backward) {
+    name_ = "layer/" + label + "/" +
+        Dims(shape[0], shape[1], shape.size() > 2 ? shape[2] : 0,
+             shape.size() > 3 ? shape[3] : 0) +
+        (backward ? "/backward" : "/forward");
+  }
+  virtual void SetUp() {
+    LayerParameter layer_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(param_, &layer_param))
+        << "Invalid layer parameter for " << name_;
+    layer_param.set_name(label_);
+    layer_param.set_phase(TRAIN);
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<float> filler(filler_param);
+    for (int i = 0; i < num_bottoms_; ++i) {
+      bottom_.push_back(new Blob<float>(shape_));
+      filler.Fill(bottom_.back());
+    }
+    top_.push_back(new Blob<float>());
+    layer_ = LayerRegistry<float>::CreateLayer(layer_param);
+    layer_->SetUp(bottom_, top_);
+    propagate_down_.assign(num_bottoms_, true);
+    if (backward_) {
+      layer_->Forward(bottom_, top_);
+      for (int i = 0; i < top_.size(); ++i) {
+        caffe_rng_gaussian<float>(top_[i]->count(), 0, 1,
+            top_[i]->mutable_cpu_diff());
+      }
+    }
+  }
+  virtual ~LayerBenchmark() {
+    for (int i = 0; i < bottom_.size(); ++i) { delete bottom_[i]; }
+    for (int i = 0; i < top_.size(); ++i) { delete top_[i]; }
+  }
+  virtual void Run() {
+    if (backward_) {
+      layer_->Backward(top_, propagate_down_, bottom_);
+    } else {
+      layer_->Forward(bottom_, top_);
+    }
+  }
+
+ private:
+  string label_;
+  string param_;
+  vector<int> shape_;
+  int num_bottoms_;
+  bool backward_;
+  shared_ptr<Layer<float> > layer_;
+  vector<Blob<float>*> bottom_, top_;
+  vector<bool> propagate_down_;
+};
+
+vector<int> Shape(int num, int channels, int height = 0, int width = 0) {
+  vector<int> shape;
+  shape.push_back(num);
+  shape.push_back(channels);
+  if (height > 0) { shape.push_back(height); }
+  if (width > 0) { shape.push_back(width); }
+  return shape;
+}
+
+void AddLayer(const string& label, const string& param,
+    const vector<int>& shape, int num_bottoms,
+    vector<shared_ptr<Benchmark> >* benchmarks) {
+  benchmarks->push_back(shared_ptr<Benchmark>(
+      new LayerBenchmark(label, param, shape, num_bottoms, false)));
+  benchmarks->push_back(shared_ptr<Benchmark>(
+      new LayerBenchmark(label, param, shape, num_bottoms, true)));
+}
+
+// The suite, on shapes from the stages of common ImageNet networks.
+vector<shared_ptr<Benchmark> > Suite() {
+  vector<shared_ptr<Benchmark> > suite;
+  // The GEMMs of a 3x3 convolution at 56x56 and 14x14, of a fully connected
+  // classifier and a square one.
+  suite.push_back(shared_ptr<Benchmark>(new GemmBenchmark(64, 3136, 576)));
+  suite.push_back(shared_ptr<Benchmark>(new GemmBenchmark(256, 196, 2304)));
+  suite.push_back(shared_ptr<Benchmark>(new GemmBenchmark(32, 1000, 4096)));
+  suite.push_back(shared_ptr<Benchmark>(new GemmBenchmark(512, 512, 512)));
+  // In cache, and streaming from memory.
+  suite.push_back(shared_ptr<Benchmark>(new AxpyBenchmark(1 << 14)));
+  suite.push_back(shared_ptr<Benchmark>(new AxpyBenchmark(1 << 22)));
+  suite.push_back(shared_ptr<Benchmark>(new ExpBenchmark(1 << 14)));
+  suite.push_back(shared_ptr<Benchmark>(new ExpBenchmark(1 << 22)));
+  for (int reverse = 0; reverse < 2; ++reverse) {
+    suite.push_back(shared_ptr<Benchmark>(
+        new Im2colBenchmark(3, 224, 7, 3, 2, reverse)));
+    suite.push_back(shared_ptr<Benchmark>(
+        new Im2colBenchmark(64, 56, 3, 1, 1, reverse)));
+    suite.push_back(shared_ptr<Benchmark>(
+        new Im2colBenchmark(256, 14, 3, 1, 1, reverse)));
+  }
+  suite.push_back(shared_ptr<Benchmark>(new TransformBenchmark()));
+  suite.push_back(shared_ptr<Benchmark>(new QueueBenchmark(false)));
+  suite.push_back(shared_ptr<Benchmark>(new QueueBenchmark(true)));
+  const string filler = "weight_filler { type: 'gaussian' std: 0.01 } ";
+  AddLayer("conv3x3", "type: 'Convolution' convolution_param { "
+      "num_output: 64 kernel_size: 3 pad: 1 " + filler + "}",
+      Shape(8, 64, 56, 56), 1, &suite);
+  AddLayer("conv1x1", "type: 'Convolution' convolution_param { "
+      "num_output: 256 kernel_size: 1 " + filler + "}",
+      Shape(8, 64, 56, 56), 1, &suite);
+  AddLayer("conv3x3_s2", "type: 'Convolution' convolution_param { "
+      "num_output: 256 kernel_size: 3 pad: 1 stride: 2 " + filler + "}",
+      Shape(8, 128, 28, 28), 1, &suite);
+  // A late stage, per image and with the whole batch in one GEMM.
+  AddLayer("conv3x3_7x7", "type: 'Convolution' convolution_param { "
+      "num_output: 512 kernel_size: 3 pad: 1 " + filler + "}",
+      Shape(8, 512, 7, 7), 1, &suite);
+  AddLayer("conv3x3_7x7_batched", "type: 'Convolution' convolution_param { "
+      "num_output: 512 kernel_size: 3 pad: 1 gemm_batch_bytes: 16777216 " +
+      filler + "}", Shape(8, 512, 7, 7), 1, &suite);
+  AddLayer("depthwise3x3", "type: 'Convolution' convolution_param { "
+      "num_output: 128 group: 128 kernel_size: 3 pad: 1 " + filler + "}",
+      Shape(8, 128, 56, 56), 1, &suite);
+  AddLayer("max_pool3x3_s2", "type: 'Pooling' pooling_param { "
+      "pool: MAX kernel_size: 3 stride: 2 }", Shape(8, 64, 112, 112), 1,
+      &suite);
+  AddLayer("ave_pool2x2_s2", "type: 'Pooling' pooling_param { "
+      "pool: AVE kernel_size: 2 stride: 2 }", Shape(8, 256, 56, 56), 1,
+      &suite);
+  AddLayer("inner_product", "type: 'InnerProduct' inner_product_param { "
+      "num_output: 1000 " + filler + "}", Shape(32, 4096), 1, &suite);
+  AddLayer("relu", "type: 'ReLU'", Shape(8, 64, 112, 112), 1, &suite);
+  AddLayer("sigmoid", "type: 'Sigmoid'", Shape(8, 64, 56, 56), 1, &suite);
+  AddLayer("tanh", "type: 'TanH'", Shape(8, 64, 56, 56), 1, &suite);
+  AddLayer("lrn", "type: 'LRN' lrn_param { local_size: 5 }",
+      Shape(8, 96, 55, 55), 1, &suite);
+  AddLayer("batch_norm", "type: 'BatchNorm'", Shape(8, 64, 56, 56), 1,
+      &suite);
+  AddLayer("softmax", "type: 'Softmax'", Shape(32, 1000), 1, &suite);
+  AddLayer("dropout", "type: 'Dropout'", Shape(32, 4096), 1, &suite);
+  AddLayer("eltwise_sum", "type: 'Eltwise'", Shape(8, 256, 56, 56), 2,
+      &suite);
+  AddLayer("concat", "type: 'Concat'", Shape(8, 256, 28, 28), 2, &suite);
+  return suite;
+}
+
+struct Result {
+  string name;
+  int iterations;
+  float mean_us, p50_us, p90_us, min_us;
+};
+
+Result Time(Benchmark* benchmark) {
+  benchmark->SetUp();
+  benchmark->Run();
+  vector<float> times;
+  double total_us = 0;
+  CPUTimer timer;
+  while (times.size() < FLAGS_min_iterations ||
+         total_us < FLAGS_min_time * 1e6) {
+    timer.Start();
+    benchmark->Run();
+    timer.Stop();
+    times.push_back(timer.MicroSeconds());
+    total_us += times.back();
+  }
+  Result result;
+  result.name = benchmark->name();
+  result.iterations = times.size();
+  result.mean_us = total_us / times.size();
+  result.p50_us = Profiler::Percentile(times, 50);
+  result.p90_us = Profiler::Percentile(times, 90);
+  result.min_us = Profiler::Percentile(times, 0);
+  return result;
+}
+
+void WriteResults(const vector<Result>& results, const string& filename) {
+  std::ofstream out(filename.c_str());
+  CHECK(out.good()) << "Failed to open " << filename;
+  out << "name,iterations,mean_us,p50_us,p90_us,min_us\n";
+  for (int i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << r.name << "," << r.iterations << "," << r.mean_us << ","
+        << r.p50_us << "," << r.p90_us << "," << r.min_us << "\n";
+  }
+  CHECK(out.good()) << "Failed to write " << filename;
+}
+
+// Reads the median times of a results file, by benchmark name.
+std::map<string, float> ReadBaseline(const string& filename) {
+  std::ifstream in(filename.c_str());
+  CHECK(in.good()) << "Failed to open baseline " << filename;
+  std::map<string, float> baseline;
+  string line;
+  std::getline(in, line);
+  CHECK_EQ(0, line.find("name,iterations,mean_us,p50_us"))
+      << "Not a benchmark results file: " << filename;
+  while (std::getline(in, line)) {
+    vector<string> fields;
+    boost::split(fields, line, boost::is_any_of(","));
+    if (fields.size() < 4) { continue; }
+    baseline[fields[0]] = atof(fields[3].c_str());
+  }
+  return baseline;
+}
+
+// Logs the change of each median time from the baseline; returns the
+// number of regressions beyond the tolerance.
+int Compare(const vector<Result>& results,
+    const std::map<string, float>& baseline) {
+  int regressions = 0;
+  for (int i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::map<string, float>::const_iterator it = baseline.find(r.name);
+    if (it == baseline.end() || it->second <= 0) {
+      LOG(INFO) << r.name << ": not in the baseline";
+      continue;
+    }
+    const float change = r.p50_us / it->second - 1;
+    std::ostringstream message;
+    message << r.name << ": " << r.p50_us << " us vs " << it->second
+            << " us (" << (change >= 0 ? "+" : "") << change * 100 << "%)";
+    if (change > FLAGS_tolerance) {
+      LOG(WARNING) << "Regression " << message.str();
+      ++regressions;
+    } else {
+      LOG(INFO) << message.str();
+    }
+  }
+  return regressions;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Run micro-benchmarks of the Caffe CPU kernels "
+      "and layers.\n"
+      "Usage:\n"
+      "    benchmark [-filter gemm] [-output results.csv] "
+      "[-baseline baseline.csv]\n");
+  GlobalInit(&argc, &argv);
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_random_seed(1701);
+
+  vector<shared_ptr<Benchmark> > suite = Suite();
+  vector<Result> results;
+  for (int i = 0; i < suite.size(); ++i) {
+    if (suite[i]->name().find(FLAGS_filter) == string::npos) { continue; }
+    if (FLAGS_list) {
+      LOG(INFO) << suite[i]->name();
+      continue;
+    }
+    results.push_back(Time(suite[i].get()));
+    // Free the inputs before the next benchmark.
+    suite[i].reset();
+    const Result& r = results.back();
+    LOG(INFO) << r.name << "\tp50 " << r.p50_us << " us, p90 " << r.p90_us
+              << " us, min " << r.min_us << " us (" << r.iterations
+              << " runs)";
+  }
+  if (FLAGS_list) { return 0; }
+  if (FLAGS_output.size()) {
+    WriteResults(results, FLAGS_output);
+    LOG(INFO) << "Results written to " << FLAGS_output;
+  }
+  if (FLAGS_baseline.size()) {
+    const int regressions = Compare(results, ReadBaseline(FLAGS_baseline));
+    if (regressions > 0) {
+      LOG(ERROR) << regressions << " benchmarks regressed by more than "
+                 << FLAGS_tolerance * 100 << "%";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -6,6 +6,7 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <climits>
 #include <cstring>
 #include <map>
 #include <string>
@@ -13,16 +14,21 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/conv_algorithm_cache.hpp"
+#include "caffe/util/cpu_features.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
 using caffe::Caffe;
 using caffe::Net;
 using caffe::Layer;
+using caffe::MemoryTracker;
+using caffe::Profiler;
 using caffe::Solver;
 using caffe::shared_ptr;
 using caffe::string;
 using caffe::Timer;
+using caffe::Tracer;
 using caffe::vector;
 using std::ostringstream;
 
@@ -54,6 +60,43 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_int32(warmup, 1,
+    "Optional; the number of untimed iterations to run before timing "
+    "'time'.");
+DEFINE_bool(forward_only, false,
+    "Optional; 'time' only the forward pass, in the TEST phase unless "
+    "-phase is given.");
+DEFINE_string(batch_sizes, "",
+    "Optional; 'time' the model at each of these batch sizes, separated by "
+    "',', and report the one with the highest throughput.");
+DEFINE_string(threads, "",
+    "Optional; 'time' the model with each of these numbers of layer threads "
+    "(see NetParameter.layer_threads), separated by ','.");
+DEFINE_int32(host_memory_pool_mb, 0,
+    "Optional; cache up to this many MB of freed host memory by size class "
+    "for reuse, e.g. when input shapes vary.");
+DEFINE_string(huge_pages, "",
+    "Optional; back large host memory blocks with 'transparent' or "
+    "'explicit' (reserved) huge pages.");
+DEFINE_string(conv_algorithm_cache, "",
+    "Optional; remember the CPU convolution algorithms chosen by AUTOTUNE in "
+    "this file instead of ~/.caffe/conv_algorithms.tsv.");
+DEFINE_string(trace, "",
+    "Optional; 'train' writes a Chrome trace (for chrome://tracing or "
+    "Perfetto) of the work on all threads to this file.");
+DEFINE_string(profile, "",
+    "Optional; 'time' writes the per-layer profile (latency percentiles, "
+    "FLOPs, bytes moved and roofline) to this file, as CSV if it ends in "
+    ".csv and JSON otherwise.");
+DEFINE_bool(perf_counters, false,
+    "Optional; read the CPU performance counters (cycles, instructions, "
+    "cache misses...) around each layer for the profile.");
+DEFINE_double(peak_gflops, 0,
+    "Optional; the peak GFLOP/s of the host, to classify layers in the "
+    "profile as compute- or bandwidth-bound.");
+DEFINE_double(peak_gbps, 0,
+    "Optional; the peak memory bandwidth of the host in GB/s, for the "
+    "profile.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -127,6 +170,31 @@ vector<string> get_stages_from_flags() {
   return stages;
 }
 
+// Set up the host memory allocator from flags.
+void set_host_allocator_from_flags() {
+  caffe::AlignedAllocator::HugePages huge_pages =
+      caffe::AlignedAllocator::NONE;
+  if (FLAGS_huge_pages == "transparent") {
+    huge_pages = caffe::AlignedAllocator::TRANSPARENT;
+  } else if (FLAGS_huge_pages == "explicit") {
+    huge_pages = caffe::AlignedAllocator::EXPLICIT;
+  } else {
+    CHECK(FLAGS_huge_pages.empty())
+        << "huge_pages must be \"transparent\" or \"explicit\"";
+  }
+  if (huge_pages == caffe::AlignedAllocator::NONE &&
+      FLAGS_host_memory_pool_mb == 0) {
+    return;
+  }
+  shared_ptr<caffe::HostAllocator> allocator(
+      new caffe::AlignedAllocator(64, huge_pages));
+  if (FLAGS_host_memory_pool_mb > 0) {
+    allocator.reset(new caffe::PoolingAllocator(allocator,
+        static_cast<size_t>(FLAGS_host_memory_pool_mb) << 20));
+  }
+  caffe::HostAllocator::Set(allocator);
+}
+
 // caffe commands to call by
 //     caffe <command> <args>
 //
@@ -207,7 +275,8 @@ int train() {
   vector<int> gpus;
   get_gpus(&gpus);
   if (gpus.size() == 0) {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with "
+        << caffe::CPUISAName(caffe::cpu_isa()) << " kernels.";
     Caffe::set_mode(Caffe::CPU);
   } else {
     ostringstream s;
@@ -244,6 +313,10 @@ int train() {
     CopyLayers(solver.get(), FLAGS_weights);
   }
 
+  if (FLAGS_trace.size()) {
+    Tracer::SetThreadName("Solver");
+    Tracer::Start();
+  }
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
@@ -251,6 +324,11 @@ int train() {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
   }
+  if (FLAGS_trace.size()) {
+    Tracer::Stop();
+    Tracer::Write(FLAGS_trace);
+    LOG(INFO) << "Trace written to " << FLAGS_trace;
+  }
   LOG(INFO) << "Optimization Done.";
   return 0;
 }
@@ -276,7 +354,8 @@ int test() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with "
+        << caffe::CPUISAName(caffe::cpu_isa()) << " kernels.";
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
@@ -331,45 +410,91 @@ RegisterBrewFunction(test);
 
 
 // Time: benchmark the execution time of a model.
-int time() {
-  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
-  caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
-  vector<string> stages = get_stages_from_flags();
+// Set the batch size of all the inputs and data layers of a net.
+void set_batch_size(caffe::NetParameter* param, int batch_size) {
+  bool found = false;
+  for (int i = 0; i < param->input_shape_size(); ++i) {
+    param->mutable_input_shape(i)->set_dim(0, batch_size);
+    found = true;
+  }
+  for (int i = 0; i < param->input_dim_size(); i += 4) {
+    param->set_input_dim(i, batch_size);
+    found = true;
+  }
+  for (int i = 0; i < param->layer_size(); ++i) {
+    caffe::LayerParameter* layer = param->mutable_layer(i);
+    for (int j = 0; j < layer->input_param().shape_size(); ++j) {
+      layer->mutable_input_param()->mutable_shape(j)->set_dim(0, batch_size);
+      found = true;
+    }
+    caffe::DummyDataParameter* dummy = layer->mutable_dummy_data_param();
+    for (int j = 0; j < dummy->shape_size(); ++j) {
+      dummy->mutable_shape(j)->set_dim(0, batch_size);
+      found = true;
+    }
+    for (int j = 0; j < dummy->num_size(); ++j) {
+      dummy->set_num(j, batch_size);
+      found = true;
+    }
+    if (layer->has_data_param()) {
+      layer->mutable_data_param()->set_batch_size(batch_size);
+      found = true;
+    }
+    if (layer->has_image_data_param()) {
+      layer->mutable_image_data_param()->set_batch_size(batch_size);
+      found = true;
+    }
+    if (layer->has_hdf5_data_param()) {
+      layer->mutable_hdf5_data_param()->set_batch_size(batch_size);
+      found = true;
+    }
+    if (layer->has_memory_data_param()) {
+      layer->mutable_memory_data_param()->set_batch_size(batch_size);
+      found = true;
+    }
+    if (layer->has_window_data_param()) {
+      layer->mutable_window_data_param()->set_batch_size(batch_size);
+      found = true;
+    }
+  }
+  CHECK(found) << "The model has no inputs or data layers to set the batch "
+               << "size of.";
+}
 
-  // Set device id and mode
-  vector<int> gpus;
-  get_gpus(&gpus);
-  if (gpus.size() != 0) {
-    LOG(INFO) << "Use GPU with device ID " << gpus[0];
-    Caffe::SetDevice(gpus[0]);
-    Caffe::set_mode(Caffe::GPU);
-  } else {
-    LOG(INFO) << "Use CPU.";
-    Caffe::set_mode(Caffe::CPU);
+// Parse a list of integers separated by ',' from a flag.
+vector<int> get_ints_from_flag(const string& flag) {
+  vector<string> strings;
+  boost::split(strings, flag, boost::is_any_of(","));
+  vector<int> ints;
+  for (int i = 0; i < strings.size(); ++i) {
+    if (!strings[i].empty()) {
+      ints.push_back(boost::lexical_cast<int>(strings[i]));
+    }
   }
-  // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  return ints;
+}
 
-  // Do a clean forward and backward pass, so that memory allocation are done
-  // and future iterations will be more stable.
-  LOG(INFO) << "Performing Forward";
+// Time a net, logging the time of each layer if log_layers.
+// Returns the latency of each timed iteration in ms.
+vector<float> time_net(Net<float>* caffe_net, bool log_layers) {
+  const bool backward = !FLAGS_forward_only;
+  // Do clean passes, so that memory allocation are done and future
+  // iterations will be more stable.
   // Note that for the speed benchmark, we will assume that the network does
   // not take any input blobs.
-  float initial_loss;
-  caffe_net.Forward(&initial_loss);
-  LOG(INFO) << "Initial loss: " << initial_loss;
-  LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
-
-  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
+  for (int j = 0; j < FLAGS_warmup; ++j) {
+    float loss;
+    caffe_net->Forward(&loss);
+    if (j == 0) { LOG(INFO) << "Initial loss: " << loss; }
+    if (backward) { caffe_net->Backward(); }
+  }
+
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = caffe_net->top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
-  LOG(INFO) << "*** Benchmark begins ***";
+      caffe_net->bottom_need_backward();
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
-  Timer total_timer;
-  total_timer.Start();
   Timer forward_timer;
   Timer backward_timer;
   Timer timer;
@@ -377,6 +502,8 @@ int time() {
   std::vector<double> backward_time_per_layer(layers.size(), 0.0);
   double forward_time = 0.0;
   double backward_time = 0.0;
+  vector<float> latencies;
+  Profiler::set_enabled(FLAGS_profile.size() > 0);
   for (int j = 0; j < FLAGS_iterations; ++j) {
     Timer iter_timer;
     iter_timer.Start();
@@ -387,40 +514,180 @@ int time() {
       forward_time_per_layer[i] += timer.MicroSeconds();
     }
     forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+    if (backward) {
+      backward_timer.Start();
+      for (int i = layers.size() - 1; i >= 0; --i) {
+        timer.Start();
+        layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
+                            bottom_vecs[i]);
+        backward_time_per_layer[i] += timer.MicroSeconds();
+      }
+      backward_time += backward_timer.MicroSeconds();
+    }
+    latencies.push_back(iter_timer.MicroSeconds() / 1000);
+    if (log_layers) {
+      LOG(INFO) << "Iteration: " << j + 1
+                << (backward ? " forward-backward" : " forward") << " time: "
+                << latencies.back() << " ms.";
+    }
+  }
+  Profiler::set_enabled(false);
+  if (log_layers) {
+    LOG(INFO) << "Average time per layer: ";
+    for (int i = 0; i < layers.size(); ++i) {
+      const caffe::string& layername = layers[i]->layer_param().name();
+      LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
+        "\tforward: " << forward_time_per_layer[i] / 1000 /
+        FLAGS_iterations << " ms.";
+      if (backward) {
+        LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
+          "\tbackward: " << backward_time_per_layer[i] / 1000 /
+          FLAGS_iterations << " ms.";
+      }
     }
-    backward_time += backward_timer.MicroSeconds();
-    LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
-      << iter_timer.MilliSeconds() << " ms.";
-  }
-  LOG(INFO) << "Average time per layer: ";
-  for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
   }
-  total_timer.Stop();
   LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
     FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  if (backward) {
+    LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
+      FLAGS_iterations << " ms.";
+  }
+  return latencies;
+}
+
+// Time: benchmark the execution time of a model, optionally sweeping over
+// batch sizes and layer threads.
+int time() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  CHECK_GT(FLAGS_iterations, 0) << "Need at least one iteration to time.";
+  caffe::Phase phase = get_phase_from_flags(
+      FLAGS_forward_only ? caffe::TEST : caffe::TRAIN);
+  vector<string> stages = get_stages_from_flags();
+  vector<int> batch_sizes = get_ints_from_flag(FLAGS_batch_sizes);
+  vector<int> threads = get_ints_from_flag(FLAGS_threads);
+  const bool sweep = batch_sizes.size() > 0 || threads.size() > 0;
+  CHECK(!sweep || FLAGS_profile.empty())
+      << "Profiles can not be written when sweeping.";
+  // Keep the batch size or threads of the model if not swept.
+  if (batch_sizes.empty()) { batch_sizes.push_back(0); }
+  if (threads.empty()) { threads.push_back(-1); }
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU with "
+        << caffe::CPUISAName(caffe::cpu_isa()) << " kernels.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  caffe::NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  net_param.mutable_state()->set_phase(phase);
+  net_param.mutable_state()->set_level(FLAGS_level);
+  for (int i = 0; i < stages.size(); i++) {
+    net_param.mutable_state()->add_stage(stages[i]);
+  }
+
+  LOG(INFO) << "*** Benchmark begins ***";
+  if (FLAGS_profile.size()) {
+    Profiler::Get()->set_peak(FLAGS_peak_gflops, FLAGS_peak_gbps);
+    Profiler::set_counters_enabled(FLAGS_perf_counters);
+  }
+  float best_throughput = 0;
+  int best_batch_size = 0;
+  int best_threads = 0;
+  ostringstream table;
+  for (int t = 0; t < threads.size(); ++t) {
+    for (int b = 0; b < batch_sizes.size(); ++b) {
+      caffe::NetParameter param(net_param);
+      if (batch_sizes[b] > 0) { set_batch_size(&param, batch_sizes[b]); }
+      if (threads[t] >= 0) { param.set_layer_threads(threads[t]); }
+      // Instantiate the caffe net.
+      Net<float> caffe_net(param);
+      const int batch_size = caffe_net.blobs()[0]->num_axes() > 0 ?
+          caffe_net.blobs()[0]->shape(0) : 1;
+      if (sweep) {
+        LOG(INFO) << "Batch size " << batch_size << ", "
+                  << param.layer_threads() << " layer threads:";
+      }
+      const vector<float> latencies = time_net(&caffe_net, !sweep);
+      float total = 0;
+      for (int i = 0; i < latencies.size(); ++i) { total += latencies[i]; }
+      const float mean = total / latencies.size();
+      const float throughput = batch_size * 1000 / mean;
+      ostringstream summary;
+      summary << "p50 " << Profiler::Percentile(latencies, 50) << " ms, p95 "
+              << Profiler::Percentile(latencies, 95) << " ms, p99 "
+              << Profiler::Percentile(latencies, 99) << " ms, "
+              << throughput << " samples/s";
+      LOG(INFO) << "Average " << (FLAGS_forward_only ? "Forward" :
+                                  "Forward-Backward") << ": " << mean
+                << " ms (" << summary.str() << ").";
+      LOG(INFO) << "Total Time: " << total << " ms.";
+      table << "\n" << std::setw(10) << batch_size << std::setw(10)
+            << param.layer_threads() << "\t" << summary.str();
+      if (throughput > best_throughput) {
+        best_throughput = throughput;
+        best_batch_size = batch_size;
+        best_threads = param.layer_threads();
+      }
+    }
+  }
+  if (sweep) {
+    LOG(INFO) << "Sweep results:\n     batch   threads" << table.str();
+    LOG(INFO) << "Best throughput: " << best_throughput << " samples/s at "
+              << "batch size " << best_batch_size << " with " << best_threads
+              << " layer threads.";
+  }
+  if (FLAGS_profile.size()) {
+    LOG(INFO) << "Profile per layer: ";
+    Profiler::Get()->LogSummary();
+    Profiler::Get()->Write(FLAGS_profile);
+    LOG(INFO) << "Profile written to " << FLAGS_profile;
+  }
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Memory: report the host memory of a model, or of a solver and its nets,
+// by owner and kind.
+int memory() {
+  CHECK(FLAGS_model.size() || FLAGS_solver.size())
+      << "Need a model or solver definition to report the memory of.";
+  Caffe::set_mode(Caffe::CPU);
+  vector<string> stages = get_stages_from_flags();
+  // Run an iteration, so that the memory allocated on first use is counted.
+  shared_ptr<Net<float> > caffe_net;
+  shared_ptr<caffe::Solver<float> > solver;
+  if (FLAGS_solver.size()) {
+    caffe::SolverParameter solver_param;
+    caffe::ReadSolverParamsFromTextFileOrDie(FLAGS_solver, &solver_param);
+    solver_param.mutable_train_state()->set_level(FLAGS_level);
+    for (int i = 0; i < stages.size(); i++) {
+      solver_param.mutable_train_state()->add_stage(stages[i]);
+    }
+    solver_param.set_solver_mode(caffe::SolverParameter_SolverMode_CPU);
+    solver.reset(caffe::SolverRegistry<float>::CreateSolver(solver_param));
+    solver->Step(1);
+  } else {
+    caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
+    caffe_net.reset(new Net<float>(FLAGS_model, phase, FLAGS_level, &stages));
+    caffe_net->Forward();
+    if (phase == caffe::TRAIN) {
+      caffe_net->Backward();
+    }
+  }
+  LOG(INFO) << "Memory by owner and kind: ";
+  MemoryTracker::Get()->LogReport(INT_MAX);
+  return 0;
+}
+RegisterBrewFunction(memory);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -433,9 +700,14 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  memory          report the memory of a model by layer and kind");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  set_host_allocator_from_flags();
+  if (!FLAGS_conv_algorithm_cache.empty()) {
+    caffe::ConvAlgorithmCache::Get()->set_path(FLAGS_conv_algorithm_cache);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {